@@ -0,0 +1,212 @@
+/*
+ * Compares ways of compositing inputs into a packed image: one memcpy per
+ * row, which is what FreeImage_Paste does for 32-bit images, [blit] on one
+ * thread, and [blit] spread across a [pool] one input at a time, which is what
+ * pngsquare does now.
+ *
+ * The workload fills a square atlas with rectangles of random sizes, laid out
+ * on shelves so that they don't overlap, each with its own source pixels.
+ * The atlas and the sources are written once before timing, so that page
+ * faults don't count against whichever variant runs first.
+ *
+ * usage: bench_blit [side] [rounds] [jobs]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "pool.h"
+#include "blit.h"
+
+/**
+ * A [sprite] is one rectangle of the workload, with its source pixels.
+ */
+struct sprite {
+    unsigned x;
+    unsigned y;
+    unsigned w;
+    unsigned h;
+    unsigned char *pixels;
+};
+
+/**
+ * A [workload] is an atlas of [side] by [side] 32-bit pixels and the [n]
+ * [sprites] to composite into it.
+ */
+struct workload {
+    unsigned char *atlas;
+    unsigned side;
+    struct sprite *sprites;
+    unsigned n;
+};
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+run_memcpy(struct workload *work)
+{
+    size_t pitch = 4 * (size_t)work->side;
+    for (unsigned i = 0; i < work->n; i++) {
+        const struct sprite *s = &work->sprites[i];
+        for (unsigned y = 0; y < s->h; y++) {
+            memcpy(work->atlas + (s->y + y) * pitch + 4 * (size_t)s->x, s->pixels + y * 4 * (size_t)s->w,
+                    4 * (size_t)s->w);
+        }
+    }
+}
+
+static void
+blit_sprite(void *ctx, unsigned i)
+{
+    struct workload *work = ctx;
+    const struct sprite *s = &work->sprites[i];
+    size_t pitch = 4 * (size_t)work->side;
+
+    blit(work->atlas + s->y * pitch + 4 * (size_t)s->x, pitch, s->pixels, 4 * (ptrdiff_t)s->w, s->w, s->h);
+}
+
+static void
+run_blit(struct workload *work)
+{
+    for (unsigned i = 0; i < work->n; i++)
+        blit_sprite(work, i);
+}
+
+static uint64_t
+checksum(const struct workload *work)
+{
+    uint64_t sum = 0;
+    size_t len = 4 * (size_t)work->side * work->side;
+    for (size_t i = 0; i < len; i += 4093)
+        sum = sum * 31 + work->atlas[i];
+    return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned side = argc > 1 ? atoi(argv[1]) : 8192;
+    unsigned rounds = argc > 2 ? atoi(argv[2]) : 5;
+    unsigned jobs = argc > 3 ? atoi(argv[3]) : ncpus();
+    if (side < 256 || rounds < 1 || jobs < 1) {
+        fprintf(stderr, "usage: %s [side >= 256] [rounds] [jobs]\n", argv[0]);
+        return 1;
+    }
+
+    struct workload work;
+    work.side = side;
+    work.atlas = malloc(4 * (size_t)side * side);
+    assert(work.atlas != NULL);
+    memset(work.atlas, 0, 4 * (size_t)side * side);
+
+    // Lay out shelves of random rectangles from 16 to 256 pixels a side
+    // until the atlas is full.
+    unsigned cap = 1024;
+    work.sprites = malloc(cap * sizeof(struct sprite));
+    assert(work.sprites != NULL);
+    work.n = 0;
+
+    srand(1);
+    double bytes = 0;
+    unsigned x = 0, y = 0, shelf = 0;
+    for (;;) {
+        unsigned w = 16 + rand() % 241;
+        unsigned h = 16 + rand() % 241;
+        if (x + w > side) {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        if (y + h > side)
+            break;
+
+        if (work.n == cap) {
+            cap *= 2;
+            work.sprites = realloc(work.sprites, cap * sizeof(struct sprite));
+            assert(work.sprites != NULL);
+        }
+
+        struct sprite *s = &work.sprites[work.n++];
+        s->x = x;
+        s->y = y;
+        s->w = w;
+        s->h = h;
+        s->pixels = malloc(4 * (size_t)w * h);
+        assert(s->pixels != NULL);
+        for (size_t k = 0; k < 4 * (size_t)w * h; k++)
+            s->pixels[k] = rand();
+
+        bytes += 4.0 * w * h;
+        x += w;
+        if (h > shelf)
+            shelf = h;
+    }
+
+    struct pool *pool = pool_alloc(jobs);
+    assert(pool != NULL);
+
+    // Keep the best of [rounds] runs of each, so that a noisy round doesn't
+    // count against any.
+    double best[3] = { 1e30, 1e30, 1e30 };
+    uint64_t sums[3] = { 0, 0, 0 };
+
+    for (unsigned round = 0; round < rounds; round++) {
+        memset(work.atlas, 0, 4 * (size_t)side * side);
+        double t = now();
+        run_memcpy(&work);
+        t = now() - t;
+        if (t < best[0])
+            best[0] = t;
+        sums[0] = checksum(&work);
+
+        memset(work.atlas, 0, 4 * (size_t)side * side);
+        t = now();
+        run_blit(&work);
+        t = now() - t;
+        if (t < best[1])
+            best[1] = t;
+        sums[1] = checksum(&work);
+
+        memset(work.atlas, 0, 4 * (size_t)side * side);
+        t = now();
+        pool_for(pool, work.n, blit_sprite, &work);
+        t = now() - t;
+        if (t < best[2])
+            best[2] = t;
+        sums[2] = checksum(&work);
+    }
+
+    if (sums[0] != sums[1] || sums[1] != sums[2]) {
+        fprintf(stderr, "bench_blit: the atlases differ (checksums %llx, %llx and %llx)\n",
+                (unsigned long long)sums[0], (unsigned long long)sums[1], (unsigned long long)sums[2]);
+        return 1;
+    }
+
+    printf("%ux%u atlas, %u sprites, %.0f MB copied, best of %u rounds\n", side, side, work.n, bytes / 1e6,
+            rounds);
+    char labels[3][32];
+    snprintf(labels[0], sizeof(labels[0]), "memcpy:");
+    snprintf(labels[1], sizeof(labels[1]), "blit (%s):", blit_isa());
+    snprintf(labels[2], sizeof(labels[2]), "blit, %u job%s:", jobs, jobs == 1 ? "" : "s");
+    for (unsigned k = 0; k < 3; k++)
+        printf("%-18s %8.2f ms  %6.2f GB/s\n", labels[k], best[k] * 1e3, bytes / best[k] / 1e9);
+    printf("%-18s %.2fx\n", "speedup:", best[0] / best[2]);
+
+    pool_free(pool);
+    for (unsigned i = 0; i < work.n; i++)
+        free(work.sprites[i].pixels);
+    free(work.sprites);
+    free(work.atlas);
+    return 0;
+}
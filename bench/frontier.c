@@ -0,0 +1,193 @@
+/*
+ * Compares the frontier heuristic's priority queues on a synthetic packing
+ * workload: the ccan [heap] of malloc'd [posn]s the packer used to use, and
+ * the [frontier] it uses now.
+ *
+ * The workload replays what [pack_frontier] does to its queue, without the
+ * grid: for every box, a few positions are popped and queued for a retry, one
+ * more is popped to place the box at, its two corners are pushed, and then
+ * the retries are pushed back.
+ *
+ * usage: bench_frontier [boxes] [rounds]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <time.h>
+
+#include "heap.h"
+#include "pack.h"
+#include "frontier.h"
+
+/**
+ * [MAX_RETRIES] is the largest number of positions popped and retried before
+ * each box is placed.
+ */
+#define MAX_RETRIES 8
+
+/**
+ * A [step] is one box of the workload.
+ */
+struct step {
+    unsigned w;
+    unsigned h;
+    unsigned retries;
+};
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * [push heap p] pushes [p] onto [heap], exiting if the heap can't grow.
+ */
+static void
+push(struct heap *heap, struct posn *p)
+{
+    if (heap_push(heap, p)) {
+        fprintf(stderr, "bench_frontier: heap_push: failed to grow the heap\n");
+        exit(1);
+    }
+}
+
+static unsigned long
+run_heap(const struct step *steps, unsigned n)
+{
+    struct heap *heap = heap_init(posn_cmp);
+    assert(heap != NULL);
+
+    struct posn *start = malloc(sizeof(struct posn));
+    assert(start != NULL);
+    start->x = 0;
+    start->y = 0;
+    push(heap, start);
+
+    struct posn *retry[MAX_RETRIES];
+    unsigned long sum = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        unsigned r = 0;
+        while (r < steps[i].retries && heap->len > 1)
+            retry[r++] = heap_pop(heap);
+
+        struct posn *top = heap_pop(heap);
+        sum += top->x + top->y;
+
+        struct posn *a = malloc(sizeof(struct posn));
+        assert(a != NULL);
+        struct posn *b = malloc(sizeof(struct posn));
+        assert(b != NULL);
+
+        a->x = top->x + steps[i].w;
+        a->y = top->y;
+        b->x = top->x;
+        b->y = top->y + steps[i].h;
+        free(top);
+
+        push(heap, a);
+        push(heap, b);
+        for (unsigned k = 0; k < r; k++)
+            push(heap, retry[k]);
+    }
+
+    for (size_t i = 0; i < heap->len; i++)
+        free(heap->data[i]);
+    heap_free(heap);
+
+    return sum;
+}
+
+static unsigned long
+run_frontier(const struct step *steps, unsigned n)
+{
+    struct frontier frontier;
+    frontier_init(&frontier);
+    frontier_reserve(&frontier, 2 * (size_t)n + 1);
+
+    struct posn start = { 0, 0 };
+    frontier_push(&frontier, start);
+
+    struct posn retry[MAX_RETRIES];
+    unsigned long sum = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        unsigned r = 0;
+        while (r < steps[i].retries && frontier.len > 1)
+            retry[r++] = frontier_pop(&frontier);
+
+        struct posn top = frontier_pop(&frontier);
+        sum += top.x + top.y;
+
+        struct posn a = { top.x + steps[i].w, top.y };
+        struct posn b = { top.x, top.y + steps[i].h };
+
+        frontier_push(&frontier, a);
+        frontier_push(&frontier, b);
+        for (unsigned k = 0; k < r; k++)
+            frontier_push(&frontier, retry[k]);
+    }
+
+    frontier_free(&frontier);
+
+    return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned n = argc > 1 ? atoi(argv[1]) : 200000;
+    unsigned rounds = argc > 2 ? atoi(argv[2]) : 5;
+    if (n < 1 || rounds < 1) {
+        fprintf(stderr, "usage: %s [boxes] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    struct step *steps = malloc(n * sizeof(struct step));
+    assert(steps != NULL);
+
+    srand(1);
+    for (unsigned i = 0; i < n; i++) {
+        steps[i].w = 1 + rand() % 8;
+        steps[i].h = 1 + rand() % 8;
+        steps[i].retries = rand() % (MAX_RETRIES + 1);
+    }
+
+    // Keep the best of [rounds] runs of each, so that a noisy round doesn't
+    // count against either.
+    double best[2] = { 1e30, 1e30 };
+    unsigned long sums[2] = { 0, 0 };
+
+    for (unsigned round = 0; round < rounds; round++) {
+        double t = now();
+        sums[0] += run_heap(steps, n);
+        t = now() - t;
+        if (t < best[0])
+            best[0] = t;
+
+        t = now();
+        sums[1] += run_frontier(steps, n);
+        t = now() - t;
+        if (t < best[1])
+            best[1] = t;
+    }
+
+    // Each box pops and pushes its retries, pops once and pushes twice.
+    double ops = 0;
+    for (unsigned i = 0; i < n; i++)
+        ops += 2.0 * steps[i].retries + 3;
+
+    printf("%u boxes, %.0f queue operations, best of %u rounds\n", n, ops, rounds);
+    printf("heap:     %8.2f ms  %6.1f ns/op  (checksum %lu)\n", best[0] * 1e3, best[0] * 1e9 / ops, sums[0]);
+    printf("frontier: %8.2f ms  %6.1f ns/op  (checksum %lu)\n", best[1] * 1e3, best[1] * 1e9 / ops, sums[1]);
+    printf("speedup:  %.2fx\n", best[0] / best[1]);
+
+    free(steps);
+    return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * Runs the stages of pngsquare that don't involve decoding PNGs on synthetic
+ * sprite sets, and reports how long each stage took, the peak resident set
+ * size once it was done, and the size and occupancy of the atlas it packed.
+ * It is meant for checking that a change to a packer, the grid or the
+ * compositing and encoding paths doesn't make any kind of input worse.
+ *
+ * The sets are generated in memory from a fixed seed:
+ *
+ *  - squares: squares from 8 to 128 pixels a side,
+ *  - powerlaw: sizes following a power law, a few large sprites among many
+ *    small ones, as in most games,
+ *  - strips: long strips 1 to 8 pixels thick, half of them on their side,
+ *  - tiny: five times as many sprites of 1 to 8 pixels a side, which
+ *    stresses the per-sprite costs.
+ *
+ * Every set is packed with each engine, and the frontier engine with both
+ * kinds of grid, after sorting it like pngsquare does without a search. The
+ * frontier engine's packing, which is the default, is then composited with
+ * [blit] across a [pool] and encoded with [encode_png] to a temporary file.
+ * Each set runs in a child process of its own, and the peak RSS is reset
+ * before each stage where Linux allows it, so that each figure is the peak
+ * while that stage ran rather than the peak so far.
+ *
+ * usage: bench_suite [sprites] [rounds] [jobs] [set]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "pack.h"
+#include "blit.h"
+#include "encode.h"
+
+/**
+ * A [sprite] is one image of a set, with its source pixels once they are
+ * needed.
+ */
+struct sprite {
+    struct box size;
+    struct posn at;
+    unsigned char *pixels;
+};
+
+/**
+ * A [set] is a generator of sprites. [scale] is how many sprites it makes per
+ * sprite asked for, and [gen] sets the size of one of them.
+ */
+struct set {
+    const char *name;
+    unsigned scale;
+    void (*gen)(struct box *size);
+};
+
+/**
+ * A [composite] is an atlas of [w] by [h] 32-bit pixels and the [n] [sprites]
+ * to composite into it.
+ */
+struct composite {
+    unsigned char *atlas;
+    unsigned w;
+    unsigned h;
+    const struct sprite *sprites;
+};
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * [peak_reset] resets the peak resident set size of the process to its
+ * current size, on Linux. Elsewhere the peak keeps growing from stage to
+ * stage.
+ */
+static void
+peak_reset()
+{
+    FILE *stream = fopen("/proc/self/clear_refs", "w");
+    if (stream == NULL)
+        return;
+    fputs("5", stream);
+    fclose(stream);
+}
+
+/**
+ * [peak_mb] returns the peak resident set size of the process since the last
+ * [peak_reset], in megabytes.
+ */
+static double
+peak_mb()
+{
+    // getrusage remembers the peak from before any reset, but Linux's status
+    // file doesn't.
+    FILE *stream = fopen("/proc/self/status", "r");
+    if (stream != NULL) {
+        char line[128];
+        unsigned long kb;
+        while (fgets(line, sizeof(line), stream) != NULL) {
+            if (sscanf(line, "VmHWM: %lu kB", &kb) == 1) {
+                fclose(stream);
+                return kb / 1024.0;
+            }
+        }
+        fclose(stream);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // in kilobytes on Linux, but bytes on macOS
+}
+
+/**
+ * [uniform lo hi] returns a random number from [lo] to [hi] inclusive.
+ */
+static unsigned
+uniform(unsigned lo, unsigned hi)
+{
+    return lo + rand() % (hi - lo + 1);
+}
+
+static void
+gen_squares(struct box *size)
+{
+    size->w = size->h = uniform(8, 128);
+}
+
+static void
+gen_powerlaw(struct box *size)
+{
+    // Pareto-distributed sides of at least 8 pixels with an exponent of 1.5,
+    // and an aspect ratio from 1:2 to 2:1.
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double side = 8 * pow(u, -1 / 1.5);
+    if (side > 1024)
+        side = 1024;
+    double aspect = pow(2, (double)rand() / RAND_MAX * 2 - 1);
+
+    size->w = side;
+    size->h = side * aspect < 1 ? 1 : side * aspect;
+}
+
+static void
+gen_strips(struct box *size)
+{
+    unsigned long_side = uniform(64, 1024);
+    unsigned short_side = uniform(1, 8);
+    if (rand() % 2) {
+        size->w = long_side;
+        size->h = short_side;
+    } else {
+        size->w = short_side;
+        size->h = long_side;
+    }
+}
+
+static void
+gen_tiny(struct box *size)
+{
+    size->w = uniform(1, 8);
+    size->h = uniform(1, 8);
+}
+
+static const struct set sets[] = {
+    { "squares", 1, gen_squares },
+    { "powerlaw", 1, gen_powerlaw },
+    { "strips", 1, gen_strips },
+    { "tiny", 5, gen_tiny },
+};
+
+static const struct packopts packers[] = {
+    { ENGINE_FRONTIER, RULE_BOTTOM_LEFT, false },
+    { ENGINE_FRONTIER, RULE_BOTTOM_LEFT, true },
+    { ENGINE_SKYLINE, RULE_BOTTOM_LEFT, false },
+    { ENGINE_SKYLINE, RULE_MIN_WASTE, false },
+    { ENGINE_MAXRECTS, RULE_SHORT_SIDE, false },
+};
+
+static int
+size_cmp(const void *a, const void *b)
+{
+    const struct box *i = a;
+    const struct box *j = b;
+
+    unsigned mi = i->w > i->h ? i->w : i->h;
+    unsigned mj = j->w > j->h ? j->w : j->h;
+
+    return mi < mj ? 1 : mi > mj ? -1 : 0;
+}
+
+static void
+blit_sprite(void *ctx, unsigned i)
+{
+    const struct composite *work = ctx;
+    const struct sprite *s = &work->sprites[i];
+    size_t pitch = 4 * (size_t)work->w;
+
+    blit(work->atlas + s->at.y * pitch + 4 * (size_t)s->at.x, pitch, s->pixels, 4 * (ptrdiff_t)s->size.w,
+            s->size.w, s->size.h);
+}
+
+static void
+report(const char *stage, double t, const char *detail)
+{
+    printf("  %-24s %10.2f ms %9.1f MB  %s\n", stage, t * 1e3, peak_mb(), detail);
+}
+
+static void
+run(const struct set *set, unsigned n, unsigned rounds, unsigned jobs)
+{
+    struct pool *pool = pool_alloc(jobs);
+    assert(pool != NULL);
+
+    struct box *sizes = malloc(n * sizeof(struct box) + 1);
+    assert(sizes != NULL);
+    struct posn *at = malloc(n * sizeof(struct posn) + 1);
+    assert(at != NULL);
+
+    srand(1);
+    double area = 0;
+    for (unsigned i = 0; i < n; i++) {
+        set->gen(&sizes[i]);
+        area += (double)sizes[i].w * sizes[i].h;
+    }
+    qsort(sizes, n, sizeof(struct box), size_cmp);
+
+    printf("%s: %u sprites, %.1f Mpx, best of %u rounds, %u job%s\n", set->name, n, area / 1e6, rounds, jobs,
+            jobs == 1 ? "" : "s");
+
+    // The frontier engine's packing is kept for the stages after packing.
+    struct posn *kept = malloc(n * sizeof(struct posn) + 1);
+    assert(kept != NULL);
+    unsigned w = 0, h = 0;
+
+    char detail[64];
+    for (unsigned p = 0; p < sizeof(packers) / sizeof(packers[0]); p++) {
+        peak_reset();
+        double best = 1e30;
+        for (unsigned round = 0; round < rounds; round++) {
+            double t = now();
+            pack(&packers[p], sizes, n, at, NULL);
+            t = now() - t;
+            if (t < best)
+                best = t;
+        }
+
+        unsigned pw = 0, ph = 0;
+        for (unsigned i = 0; i < n; i++) {
+            if (at[i].x + sizes[i].w > pw)
+                pw = at[i].x + sizes[i].w;
+            if (at[i].y + sizes[i].h > ph)
+                ph = at[i].y + sizes[i].h;
+        }
+        if (p == 0) {
+            memcpy(kept, at, n * sizeof(struct posn));
+            w = pw;
+            h = ph;
+        }
+
+        char stage[32];
+        snprintf(stage, sizeof(stage), "pack %s %s", engine_name(packers[p].engine),
+                packers[p].engine != ENGINE_FRONTIER ? rule_name(packers[p].rule)
+                : packers[p].indexed ? "fenwick" : "scan");
+        snprintf(detail, sizeof(detail), "%ux%u, %.1f%% occupied", pw, ph, 100 * area / ((double)pw * ph));
+        report(stage, best, detail);
+    }
+
+    // Fill the sprites and the atlas before timing, so that page faults
+    // don't count against the first round.
+    struct sprite *sprites = malloc(n * sizeof(struct sprite) + 1);
+    assert(sprites != NULL);
+    for (unsigned i = 0; i < n; i++) {
+        struct sprite *s = &sprites[i];
+        s->size = sizes[i];
+        s->at = kept[i];
+        size_t len = 4 * (size_t)s->size.w * s->size.h;
+        s->pixels = malloc(len);
+        assert(s->pixels != NULL);
+        // Opaque gradients with some noise compress about as well as art.
+        unsigned char base = rand();
+        for (size_t k = 0; k < len; k++) {
+            s->pixels[k] = k % 4 == 3 ? 255 : base * (k % 4 + 1) + k / 4 % s->size.w + k / 4 / s->size.w;
+            if (k % 4 != 3 && rand() % 8 == 0)
+                s->pixels[k] += rand() % 16;
+        }
+    }
+
+    struct composite work;
+    work.w = w;
+    work.h = h;
+    work.sprites = sprites;
+    work.atlas = malloc(4 * (size_t)w * h + 1);
+    assert(work.atlas != NULL);
+    memset(work.atlas, 0, 4 * (size_t)w * h);
+
+    peak_reset();
+    double best = 1e30;
+    for (unsigned round = 0; round < rounds; round++) {
+        double t = now();
+        pool_for(pool, n, blit_sprite, &work);
+        t = now() - t;
+        if (t < best)
+            best = t;
+    }
+    snprintf(detail, sizeof(detail), "%.2f GB/s", 4 * area / best / 1e9);
+    char stage[32];
+    snprintf(stage, sizeof(stage), "composite (%s)", blit_isa());
+    report(stage, best, detail);
+
+    char path[] = "/tmp/bench_suite.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "bench_suite: mkstemp: %s\n", strerror(errno));
+        exit(1);
+    }
+    close(fd);
+
+    // These do real work, so they stay out of [assert], which -DNDEBUG
+    // would remove.
+    struct encodeopts opts;
+    if (!encode_parse(&opts, "default")) {
+        fprintf(stderr, "bench_suite: failed to parse the encoder options\n");
+        exit(1);
+    }
+
+    peak_reset();
+    best = 1e30;
+    for (unsigned round = 0; round < rounds; round++) {
+        double t = now();
+        bool encoded = encode_png(pool, path, work.atlas, 4 * (ptrdiff_t)w, w, h, false, &opts);
+        t = now() - t;
+        if (!encoded) {
+            unlink(path);
+            exit(1);
+        }
+        if (t < best)
+            best = t;
+    }
+    struct stat st;
+    if (stat(path, &st)) {
+        fprintf(stderr, "bench_suite: stat: failed to stat %s: %s\n", path, strerror(errno));
+        unlink(path);
+        exit(1);
+    }
+    unlink(path);
+    snprintf(detail, sizeof(detail), "%.1f MB of PNG", st.st_size / 1e6);
+    report("encode", best, detail);
+
+    for (unsigned i = 0; i < n; i++)
+        free(sprites[i].pixels);
+    free(sprites);
+    free(work.atlas);
+    free(kept);
+    free(at);
+    free(sizes);
+    pool_free(pool);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned n = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned rounds = argc > 2 ? atoi(argv[2]) : 3;
+    unsigned jobs = argc > 3 ? atoi(argv[3]) : ncpus();
+    const char *only = argc > 4 ? argv[4] : NULL;
+    if (n < 1 || rounds < 1 || jobs < 1) {
+        fprintf(stderr, "usage: %s [sprites] [rounds] [jobs] [set]\n", argv[0]);
+        return 1;
+    }
+
+    bool found = false;
+    for (unsigned k = 0; k < sizeof(sets) / sizeof(sets[0]); k++) {
+        if (only != NULL && strcmp(only, sets[k].name))
+            continue;
+        found = true;
+
+        // Output is flushed before forking so that the child doesn't print
+        // it again.
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "%s: fork: %s\n", argv[0], strerror(errno));
+            return 1;
+        }
+        if (pid == 0) {
+            run(&sets[k], n * sets[k].scale, rounds, jobs);
+            fflush(stdout);
+            _exit(0);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "%s: the %s set failed\n", argv[0], sets[k].name);
+            return 1;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "%s: unknown set '%s'\n", argv[0], only);
+        return 1;
+    }
+    return 0;
+}
@@ -7,11 +7,30 @@
 
 static const char *PNG_PATH = "images/textures.png";
 
+const SDL_Rect textures_rects[textures_nrects] = {
+    [textures_rect_blob_0] = { 32, 0, 16, 16 },
+    [textures_rect_blob_1] = { 32, 16, 16, 16 },
+    [textures_rect_enemy_0] = { 32, 32, 16, 16 },
+    [textures_rect_enemy_1] = { 32, 48, 16, 16 },
+    [textures_rect_tile_normal] = { 0, 0, 32, 32 },
+    [textures_rect_tile_spikes] = { 0, 32, 32, 32 },
+};
+
+static const struct textures PACK = {
+    .blob_0 = &textures_rects[textures_rect_blob_0],
+    .blob_1 = &textures_rects[textures_rect_blob_1],
+    .enemy_0 = &textures_rects[textures_rect_enemy_0],
+    .enemy_1 = &textures_rects[textures_rect_enemy_1],
+    .tile_normal = &textures_rects[textures_rect_tile_normal],
+    .tile_spikes = &textures_rects[textures_rect_tile_spikes],
+};
+
 struct textures *
 textures_load(SDL_Renderer *renderer)
 {
     struct textures *pack = malloc(sizeof(struct textures));
     assert(pack != NULL);
+    *pack = PACK;
 
     SDL_Surface* raw = IMG_Load(PNG_PATH);
     if (raw == NULL) {
@@ -27,59 +46,11 @@ textures_load(SDL_Renderer *renderer)
 
     SDL_FreeSurface(raw);
 
-    pack->blob_0 = malloc(sizeof(SDL_Rect));
-    assert(pack->blob_0 != NULL);
-    pack->blob_0->x = 32;
-    pack->blob_0->y = 0;
-    pack->blob_0->w = 16;
-    pack->blob_0->h = 16;
-
-    pack->blob_1 = malloc(sizeof(SDL_Rect));
-    assert(pack->blob_1 != NULL);
-    pack->blob_1->x = 32;
-    pack->blob_1->y = 16;
-    pack->blob_1->w = 16;
-    pack->blob_1->h = 16;
-
-    pack->enemy_0 = malloc(sizeof(SDL_Rect));
-    assert(pack->enemy_0 != NULL);
-    pack->enemy_0->x = 32;
-    pack->enemy_0->y = 32;
-    pack->enemy_0->w = 16;
-    pack->enemy_0->h = 16;
-
-    pack->enemy_1 = malloc(sizeof(SDL_Rect));
-    assert(pack->enemy_1 != NULL);
-    pack->enemy_1->x = 48;
-    pack->enemy_1->y = 0;
-    pack->enemy_1->w = 16;
-    pack->enemy_1->h = 16;
-
-    pack->tile_normal = malloc(sizeof(SDL_Rect));
-    assert(pack->tile_normal != NULL);
-    pack->tile_normal->x = 0;
-    pack->tile_normal->y = 0;
-    pack->tile_normal->w = 32;
-    pack->tile_normal->h = 32;
-
-    pack->tile_spikes = malloc(sizeof(SDL_Rect));
-    assert(pack->tile_spikes != NULL);
-    pack->tile_spikes->x = 0;
-    pack->tile_spikes->y = 32;
-    pack->tile_spikes->w = 32;
-    pack->tile_spikes->h = 32;
-
     return pack;
 }
 
 void
 textures_unload (struct textures *pack)
 {
-    free(pack->blob_0);
-    free(pack->blob_1);
-    free(pack->enemy_0);
-    free(pack->enemy_1);
-    free(pack->tile_normal);
-    free(pack->tile_spikes);
     free(pack);
 }
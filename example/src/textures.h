@@ -3,15 +3,28 @@
 
 #include <SDL2/SDL.h>
 
+// The index of each image's rectangle in textures_rects.
+enum textures_rect {
+    textures_rect_blob_0,
+    textures_rect_blob_1,
+    textures_rect_enemy_0,
+    textures_rect_enemy_1,
+    textures_rect_tile_normal,
+    textures_rect_tile_spikes,
+    textures_nrects
+};
+
+extern const SDL_Rect textures_rects[textures_nrects];
+
 struct textures {
     SDL_Texture *t;
 
-    SDL_Rect *blob_0;
-    SDL_Rect *blob_1;
-    SDL_Rect *enemy_0;
-    SDL_Rect *enemy_1;
-    SDL_Rect *tile_normal;
-    SDL_Rect *tile_spikes;
+    const SDL_Rect *blob_0;
+    const SDL_Rect *blob_1;
+    const SDL_Rect *enemy_0;
+    const SDL_Rect *enemy_1;
+    const SDL_Rect *tile_normal;
+    const SDL_Rect *tile_spikes;
 };
 
 struct textures *textures_load(SDL_Renderer *renderer);
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stddef.h>
+
+#include <assert.h>
+
+#include "arena.h"
+
+/**
+ * [ARENA_ALIGN] is the alignment of every object, enough for any of the
+ * types stored in arenas.
+ */
+#define ARENA_ALIGN sizeof(void *)
+
+/**
+ * [ARENA_HEADER] is the space reserved at the start of each chunk for the
+ * link to the previous chunk, rounded up so objects stay aligned.
+ */
+#define ARENA_HEADER ((sizeof(void *) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+void
+arena_init(struct arena *arena, size_t size, size_t per)
+{
+    assert(size > 0 && per > 0);
+
+    // Given-back objects hold the link to the next one, so they must be big
+    // enough for a pointer.
+    if (size < sizeof(void *))
+        size = sizeof(void *);
+
+    arena->size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    arena->per = per;
+    arena->chunks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+    arena->spare = NULL;
+    arena->gets = 0;
+    arena->allocs = 0;
+}
+
+void *
+arena_get(struct arena *arena)
+{
+    arena->gets++;
+
+    if (arena->spare != NULL) {
+        void *p = arena->spare;
+        arena->spare = *(void **)p;
+        return p;
+    }
+
+    if (arena->next == arena->end) {
+        char *chunk = malloc(ARENA_HEADER + arena->size * arena->per);
+        assert(chunk != NULL);
+        arena->allocs++;
+
+        *(void **)chunk = arena->chunks;
+        arena->chunks = chunk;
+        arena->next = chunk + ARENA_HEADER;
+        arena->end = arena->next + arena->size * arena->per;
+    }
+
+    void *p = arena->next;
+    arena->next += arena->size;
+    return p;
+}
+
+void
+arena_put(struct arena *arena, void *p)
+{
+    *(void **)p = arena->spare;
+    arena->spare = p;
+}
+
+void
+arena_free(struct arena *arena)
+{
+    while (arena->chunks != NULL) {
+        void *prev = *(void **)arena->chunks;
+        free(arena->chunks);
+        arena->chunks = prev;
+    }
+
+    arena->next = NULL;
+    arena->end = NULL;
+    arena->spare = NULL;
+}
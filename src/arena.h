@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * An [arena] hands out objects of one fixed size, carving them out of large
+ * chunks instead of calling [malloc] for each one. Objects given back with
+ * [arena_put] are reused by later calls to [arena_get]. Every object, given
+ * back or not, is freed at once by [arena_free], so objects never outlive
+ * their arena.
+ * Arenas are set up with [arena_init]; they are small enough to live on the
+ * stack.
+ */
+struct arena {
+    size_t size; //!< [size] is the size of each object in bytes.
+    size_t per; //!< [per] is the number of objects carved out of each chunk.
+    void *chunks; //!< [chunks] is the most recently allocated chunk; each chunk starts with a pointer to the one before.
+    char *next; //!< [next] is the first never-used object in the newest chunk.
+    char *end; //!< [end] is the end of the newest chunk.
+    void *spare; //!< [spare] is a list of objects given back, linked through their first bytes.
+
+    unsigned long gets; //!< [gets] counts the calls to [arena_get].
+    unsigned long allocs; //!< [allocs] counts the chunks allocated.
+};
+
+/**
+ * [arena_init arena size per] sets up [arena] to hand out objects of [size]
+ * bytes, [per] at a time.
+ */
+void arena_init(struct arena *arena, size_t size, size_t per);
+
+/**
+ * [arena_get arena] returns an uninitialized object. It never returns null.
+ */
+void *arena_get(struct arena *arena);
+
+/**
+ * [arena_put arena p] gives the object [p] back to [arena] for reuse.
+ */
+void arena_put(struct arena *arena, void *p);
+
+/**
+ * [arena_free arena] frees every object [arena] has handed out. [arena] may
+ * be used again afterwards; its counters keep counting.
+ */
+void arena_free(struct arena *arena);
+
+#endif
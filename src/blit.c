@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#include <pthread.h>
+
+#include "blit.h"
+
+// Compositing is one row copy per input row, so the row copy is the whole
+// stage. On x86 it's done with SSE2, which every x86-64 processor has, or
+// with AVX2 when the processor supports it. AVX2 is picked at run time so
+// the binary still runs on older processors; that needs GCC's (or Clang's)
+// target attribute and builtins. Anywhere else rows are copied with memcpy.
+//
+// Packed images are usually far bigger than the cache, so the stores are
+// what's slow. Each row copy stores its first vector unaligned and then
+// realigns to the destination, so that no store is split across two cache
+// lines; the source is read unaligned throughout.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define BLIT_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*blit_row_func_t)(unsigned char *dst, const unsigned char *src, size_t n);
+
+static void
+blit_row_scalar(unsigned char *dst, const unsigned char *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+#ifdef BLIT_X86
+
+static void
+blit_row_sse2(unsigned char *dst, const unsigned char *src, size_t n)
+{
+    size_t i = 0;
+    if (n >= 32) {
+        _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        i = 16 - ((uintptr_t)dst & 15);
+    }
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+        _mm_store_si128((__m128i *)(dst + i), a);
+        _mm_store_si128((__m128i *)(dst + i + 16), b);
+        _mm_store_si128((__m128i *)(dst + i + 32), c);
+        _mm_store_si128((__m128i *)(dst + i + 48), d);
+    }
+    for (; i + 16 <= n; i += 16) {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i)));
+    }
+    // Rows are whole pixels, so at most three are left.
+    memcpy(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+blit_row_avx2(unsigned char *dst, const unsigned char *src, size_t n)
+{
+    size_t i = 0;
+    if (n >= 64) {
+        _mm256_storeu_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+        i = 32 - ((uintptr_t)dst & 31);
+    }
+    for (; i + 128 <= n; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+        _mm256_store_si256((__m256i *)(dst + i), a);
+        _mm256_store_si256((__m256i *)(dst + i + 32), b);
+        _mm256_store_si256((__m256i *)(dst + i + 64), c);
+        _mm256_store_si256((__m256i *)(dst + i + 96), d);
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+    }
+    if (i + 16 <= n) {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i)));
+        i += 16;
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+#endif
+
+/**
+ * [blit_row] is the row copy [blit] uses, and [blit_row_isa] its name. They
+ * are chosen by [blit_init], exactly once.
+ */
+static blit_row_func_t blit_row = blit_row_scalar;
+static const char *blit_row_isa = "scalar";
+static pthread_once_t blit_once = PTHREAD_ONCE_INIT;
+
+static void
+blit_init()
+{
+#ifdef BLIT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        blit_row = blit_row_avx2;
+        blit_row_isa = "avx2";
+    } else {
+        blit_row = blit_row_sse2;
+        blit_row_isa = "sse2";
+    }
+#endif
+}
+
+void
+blit(unsigned char *dst, ptrdiff_t dpitch, const unsigned char *src, ptrdiff_t spitch,
+        unsigned w, unsigned h)
+{
+    pthread_once(&blit_once, blit_init);
+
+    size_t n = 4 * (size_t)w;
+    for (unsigned y = 0; y < h; y++) {
+        blit_row(dst + (ptrdiff_t)y * dpitch, src + (ptrdiff_t)y * spitch, n);
+    }
+}
+
+const char *
+blit_isa()
+{
+    pthread_once(&blit_once, blit_init);
+
+    return blit_row_isa;
+}
@@ -0,0 +1,22 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stddef.h>
+
+/**
+ * [blit dst dpitch src spitch w h] copies a [w] by [h] block of 32-bit pixels
+ * from [src] to [dst], which point to the first pixel of the first row of
+ * each block. Each row starts [spitch] (or [dpitch]) bytes after the previous
+ * one, so either may be negative. The blocks must not overlap.
+ * Rows are copied with the widest vector instructions the processor has.
+ */
+void blit(unsigned char *dst, ptrdiff_t dpitch, const unsigned char *src, ptrdiff_t spitch,
+        unsigned w, unsigned h);
+
+/**
+ * [blit_isa] returns the name of the instruction set [blit] uses: "avx2",
+ * "sse2" or "scalar".
+ */
+const char *blit_isa();
+
+#endif
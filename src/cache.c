@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <unistd.h>
+
+#include "pack.h"
+#include "cache.h"
+
+/**
+ * [CACHE_MAGIC] is the first line of every cache file. Change its version
+ * whenever the format or the meaning of the cached data changes.
+ */
+#define CACHE_MAGIC "pngsquare-cache 3"
+
+#define MAX_CACHE_LINE_LEN 1100
+
+bool
+cache_read(struct cache *cache, const char *path)
+{
+    cache->npages = 0;
+    cache->pages = NULL;
+    cache->len = 0;
+    cache->entries = NULL;
+
+    FILE *stream = fopen(path, "r");
+    if (stream == NULL)
+        return false;
+
+    bool ok = false;
+    char line[MAX_CACHE_LINE_LEN];
+    char name[MAX_CACHE_LINE_LEN];
+    unsigned npages;
+    unsigned len;
+
+    if (fgets(line, sizeof(line), stream) == NULL || strcmp(line, CACHE_MAGIC "\n"))
+        goto close;
+
+    if (fscanf(stream, "key %" SCNx64 "\n", &cache->key) != 1
+            || fscanf(stream, "pages %u\n", &npages) != 1)
+        goto close;
+
+    cache->pages = calloc(npages + 1, sizeof(struct box));
+    assert(cache->pages != NULL);
+
+    for (; cache->npages < npages; cache->npages++) {
+        struct box *b = &cache->pages[cache->npages];
+        if (fscanf(stream, "size %u %u\n", &b->w, &b->h) != 2)
+            goto close;
+    }
+
+    if (fscanf(stream, "inputs %u\n", &len) != 1)
+        goto close;
+
+    cache->entries = calloc(len + 1, sizeof(struct cacheentry));
+    assert(cache->entries != NULL);
+
+    for (; cache->len < len; cache->len++) {
+        struct cacheentry *e = &cache->entries[cache->len];
+        if (fgets(line, sizeof(line), stream) == NULL
+                || sscanf(line, "%" SCNx64 " %u %u %u %u %u %u %u %u %u %s", &e->hash, &e->w, &e->h,
+                    &e->at.x, &e->at.y, &e->page, &e->off.x, &e->off.y, &e->ow, &e->oh, name) != 11
+                || e->page >= npages)
+            goto close;
+
+        e->name = malloc(strlen(name) + 1);
+        assert(e->name != NULL);
+        strcpy(e->name, name);
+    }
+
+    ok = true;
+
+close:
+    fclose(stream);
+
+    if (!ok)
+        cache_free(cache);
+
+    return ok;
+}
+
+bool
+cache_write(const struct cache *cache, const char *path)
+{
+    char *tmp = malloc(strlen(path) + 8); // appending {.XXXXXX, \0}
+    assert(tmp != NULL);
+    sprintf(tmp, "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        fprintf(stderr, "cache_write: mkstemp: failed to create %s: %s\n", tmp, strerror(errno));
+        free(tmp);
+        return false;
+    }
+
+    FILE *stream = fdopen(fd, "w");
+    assert(stream != NULL);
+
+    fprintf(stream, "%s\n", CACHE_MAGIC);
+    fprintf(stream, "key %016" PRIx64 "\n", cache->key);
+    fprintf(stream, "pages %u\n", cache->npages);
+    for (unsigned p = 0; p < cache->npages; p++) {
+        fprintf(stream, "size %u %u\n", cache->pages[p].w, cache->pages[p].h);
+    }
+    fprintf(stream, "inputs %u\n", cache->len);
+
+    for (unsigned i = 0; i < cache->len; i++) {
+        const struct cacheentry *e = &cache->entries[i];
+        fprintf(stream, "%016" PRIx64 " %u %u %u %u %u %u %u %u %u %s\n", e->hash, e->w, e->h, e->at.x, e->at.y,
+                e->page, e->off.x, e->off.y, e->ow, e->oh, e->name);
+    }
+
+    bool ok = true;
+
+    if (fflush(stream) || fsync(fd)) {
+        fprintf(stderr, "cache_write: failed to write %s: %s\n", tmp, strerror(errno));
+        ok = false;
+    }
+    if (fclose(stream)) {
+        fprintf(stderr, "cache_write: fclose: %s\n", strerror(errno));
+        ok = false;
+    }
+    if (ok && rename(tmp, path)) {
+        fprintf(stderr, "cache_write: rename: failed to move %s to %s: %s\n", tmp, path, strerror(errno));
+        ok = false;
+    }
+
+    if (!ok)
+        unlink(tmp);
+
+    free(tmp);
+    return ok;
+}
+
+void
+cache_free(struct cache *cache)
+{
+    for (unsigned i = 0; i < cache->len; i++) {
+        free(cache->entries[i].name);
+    }
+    free(cache->entries);
+    free(cache->pages);
+
+    cache->npages = 0;
+    cache->pages = NULL;
+    cache->len = 0;
+    cache->entries = NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pack.h"
+
+/**
+ * A [cacheentry] records what an input looked like the last time it was
+ * packed, and where it went.
+ */
+struct cacheentry {
+    char *name;
+    uint64_t hash; //!< [hash] is the [hash_file] hash of the input PNG.
+    unsigned w; //!< [w] is the width of the image in pixels.
+    unsigned h; //!< [h] is the height of the image in pixels.
+    struct posn at; //!< [at] is where the image was placed, in pixels.
+    unsigned page; //!< [page] is the index of the packed image it was placed on.
+    struct posn off; //!< [off] is the offset of the trimmed image within the original.
+    unsigned ow; //!< [ow] is the width of the original image in pixels.
+    unsigned oh; //!< [oh] is the height of the original image in pixels.
+};
+
+/**
+ * A [cache] records the outcome of a run of pngsquare, so that the next run
+ * can tell what changed since. See the README for how it's used.
+ * Caches are read with [cache_read], written with [cache_write] and their
+ * contents freed with [cache_free].
+ */
+struct cache {
+    uint64_t key; //!< [key] is a hash of everything besides the inputs that affects the outputs.
+    unsigned npages; //!< [npages] is the number of [pages].
+    struct box *pages; //!< [pages] holds the size in pixels of each packed image.
+    unsigned len; //!< [len] is the number of [entries].
+    struct cacheentry *entries; //!< [entries] describes the inputs in specification order.
+};
+
+/**
+ * [cache_read cache path] fills [cache] from the cache file at [path].
+ * Returns [false] if the file doesn't exist or isn't a valid cache file, in
+ * which case [cache] is left empty.
+ */
+bool cache_read(struct cache *cache, const char *path);
+
+/**
+ * [cache_write cache path] writes [cache] to [path]. The file is written
+ * under a temporary name first and then renamed over [path], so [path] either
+ * holds the old cache or the new one, never a partial file.
+ * Returns [false] (after printing an error) on failure.
+ */
+bool cache_write(const struct cache *cache, const char *path);
+
+void cache_free(struct cache *cache);
+
+#endif
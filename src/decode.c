@@ -0,0 +1,487 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "decode.h"
+
+/**
+ * [READ_CHUNK] is how many bytes of compressed data are read from the file at
+ * a time.
+ */
+#define READ_CHUNK (1 << 16)
+
+/**
+ * [MAX_SIDE] is the greatest width or height a PNG may have.
+ */
+#define MAX_SIDE 0x7fffffffu
+
+/**
+ * A [pass] is a subimage of an interlaced PNG, made of every [dx]th pixel of
+ * every [dy]th row, starting from column [x] of row [y]. Images that aren't
+ * interlaced are a single pass of every pixel.
+ */
+struct pass {
+    unsigned x;
+    unsigned y;
+    unsigned dx;
+    unsigned dy;
+};
+
+static const struct pass adam7[7] = {
+    { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 },
+};
+
+static const struct pass whole = { 0, 0, 1, 1 };
+
+/**
+ * A [header] holds the fields of an IHDR chunk that matter for decoding.
+ */
+struct header {
+    unsigned w;
+    unsigned h;
+    unsigned depth; //!< [depth] is the number of bits per sample: 1, 2, 4, 8 or 16.
+    unsigned color; //!< [color] is the color type: 0 (grey), 2 (RGB), 3 (palette), 4 (grey and alpha) or 6 (RGBA).
+    bool interlaced;
+};
+
+/**
+ * A [decoder] is the state of [decode_png] as it goes through the rows of
+ * each [pass] of an image. See [decode_png] for [row], [pitch] and [bgra].
+ */
+struct decoder {
+    struct header hdr;
+    unsigned channels; //!< [channels] is the number of samples per pixel.
+    unsigned bytes; //!< [bytes] is the number of bytes per pixel, rounded up to 1, which filters work with.
+    unsigned char palette[256][4]; //!< [palette] holds the RGBA colors of a palette image.
+    bool keyed; //!< [keyed] is set if a tRNS chunk makes the grey or RGB samples [key] transparent.
+    unsigned key[3];
+
+    const struct pass *passes;
+    unsigned npasses;
+    unsigned pass; //!< [pass] is the index of the pass being decoded, or [npasses] once all are.
+    unsigned y; //!< [y] is the row of the pass being decoded.
+    unsigned pw; //!< [pw] is the width of the pass.
+    unsigned ph; //!< [ph] is the height of the pass.
+    size_t rowbytes; //!< [rowbytes] is the length of a row of the pass, without its filter type byte.
+
+    /**
+     * [cur] holds the row being inflated, and [prev] the one before it in
+     * the pass, unfiltered, or zeros for the first row. Both start with the
+     * row's filter type byte.
+     */
+    unsigned char *cur;
+    unsigned char *prev;
+    size_t filled; //!< [filled] is the number of bytes of [cur] inflated so far.
+
+    unsigned char *row;
+    ptrdiff_t pitch;
+    bool bgra;
+};
+
+static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+static uint32_t
+get32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * [read_header stream hdr] reads the signature and IHDR chunk at the start of
+ * [stream] into [hdr]. Returns [false] if they aren't those of a valid PNG.
+ */
+static bool
+read_header(FILE *stream, struct header *hdr)
+{
+    // The signature, the chunk's length and type, its 13 bytes and its CRC.
+    unsigned char buf[33];
+    if (fread(buf, 1, sizeof(buf), stream) != sizeof(buf))
+        return false;
+    if (memcmp(buf, signature, sizeof(signature)) || get32(buf + 8) != 13 || memcmp(buf + 12, "IHDR", 4))
+        return false;
+
+    hdr->w = get32(buf + 16);
+    hdr->h = get32(buf + 20);
+    hdr->depth = buf[24];
+    hdr->color = buf[25];
+    hdr->interlaced = buf[28] == 1;
+    if (hdr->w == 0 || hdr->h == 0 || hdr->w > MAX_SIDE || hdr->h > MAX_SIDE)
+        return false;
+    // Only deflate, adaptive filtering, and no or Adam7 interlacing exist.
+    if (buf[26] != 0 || buf[27] != 0 || buf[28] > 1)
+        return false;
+
+    switch (hdr->color) {
+    case 0:
+        return hdr->depth == 1 || hdr->depth == 2 || hdr->depth == 4 || hdr->depth == 8 || hdr->depth == 16;
+    case 3:
+        return hdr->depth == 1 || hdr->depth == 2 || hdr->depth == 4 || hdr->depth == 8;
+    case 2:
+    case 4:
+    case 6:
+        return hdr->depth == 8 || hdr->depth == 16;
+    default:
+        return false;
+    }
+}
+
+bool
+decode_probe(const char *path, unsigned *w, unsigned *h)
+{
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
+        return false;
+
+    struct header hdr;
+    bool ok = read_header(stream, &hdr);
+    fclose(stream);
+
+    if (ok) {
+        *w = hdr.w;
+        *h = hdr.h;
+    }
+    return ok;
+}
+
+/**
+ * [pass_begin d] moves [d] to the first row of the first pass from [d->pass]
+ * on that has any pixels. Small interlaced images have empty passes, which
+ * have no rows in the file at all.
+ */
+static void
+pass_begin(struct decoder *d)
+{
+    for (; d->pass < d->npasses; d->pass++) {
+        const struct pass *p = &d->passes[d->pass];
+        d->pw = d->hdr.w > p->x ? (d->hdr.w - p->x + p->dx - 1) / p->dx : 0;
+        d->ph = d->hdr.h > p->y ? (d->hdr.h - p->y + p->dy - 1) / p->dy : 0;
+        if (d->pw == 0 || d->ph == 0)
+            continue;
+
+        d->rowbytes = ((size_t)d->pw * d->channels * d->hdr.depth + 7) / 8;
+        d->y = 0;
+        d->filled = 0;
+        memset(d->prev, 0, d->rowbytes + 1);
+        return;
+    }
+}
+
+static unsigned char
+paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/**
+ * [unfilter row prev len bytes filter] reverses the [filter] type on the
+ * [len] bytes of [row], given the unfiltered row [prev] above it. Returns
+ * [false] if there is no such filter type.
+ */
+static bool
+unfilter(unsigned char *row, const unsigned char *prev, size_t len, unsigned bytes, unsigned filter)
+{
+    // The first pixel of the row has nothing to its left, so it's done
+    // separately to keep the branch out of the loops.
+    size_t first = bytes < len ? bytes : len;
+
+    switch (filter) {
+    case 0:
+        return true;
+    case 1:
+        for (size_t i = bytes; i < len; i++)
+            row[i] += row[i - bytes];
+        return true;
+    case 2:
+        for (size_t i = 0; i < len; i++)
+            row[i] += prev[i];
+        return true;
+    case 3:
+        for (size_t i = 0; i < first; i++)
+            row[i] += prev[i] / 2;
+        for (size_t i = bytes; i < len; i++)
+            row[i] += (row[i - bytes] + prev[i]) / 2;
+        return true;
+    case 4:
+        for (size_t i = 0; i < first; i++)
+            row[i] += prev[i];
+        for (size_t i = bytes; i < len; i++)
+            row[i] += paeth(row[i - bytes], prev[i], prev[i - bytes]);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * [sample row i depth] returns the [i]th sample of [row], of [depth] bits.
+ */
+static unsigned
+sample(const unsigned char *row, size_t i, unsigned depth)
+{
+    if (depth == 8)
+        return row[i];
+    if (depth == 16)
+        return row[2 * i] << 8 | row[2 * i + 1];
+
+    size_t bit = i * depth;
+    return row[bit / 8] >> (8 - depth - bit % 8) & ((1u << depth) - 1);
+}
+
+/**
+ * [store d src] converts the unfiltered row [src] of the current pass of [d]
+ * to 32-bit pixels, and stores them where they go in [d->row].
+ */
+static void
+store(const struct decoder *d, const unsigned char *src)
+{
+    const struct pass *p = &d->passes[d->pass];
+    unsigned char *dst = d->row + (ptrdiff_t)(p->y + (size_t)d->y * p->dy) * d->pitch + 4 * (size_t)p->x;
+    size_t step = 4 * (size_t)p->dx;
+
+    unsigned depth = d->hdr.depth;
+    // 16-bit samples keep their high byte, and grey samples of less than 8
+    // bits are stretched to the full range.
+    unsigned shift = depth == 16 ? 8 : 0;
+    unsigned scale = depth < 8 ? 255 / ((1u << depth) - 1) : 1;
+    unsigned r = d->bgra ? 2 : 0;
+    unsigned b = 2 - r;
+
+    switch (d->hdr.color) {
+    case 0:
+        for (unsigned x = 0; x < d->pw; x++, dst += step) {
+            unsigned v = sample(src, x, depth);
+            dst[0] = dst[1] = dst[2] = (v >> shift) * scale;
+            dst[3] = d->keyed && v == d->key[0] ? 0 : 255;
+        }
+        break;
+    case 2:
+        for (unsigned x = 0; x < d->pw; x++, dst += step) {
+            unsigned vr = sample(src, 3 * (size_t)x, depth);
+            unsigned vg = sample(src, 3 * (size_t)x + 1, depth);
+            unsigned vb = sample(src, 3 * (size_t)x + 2, depth);
+            dst[r] = vr >> shift;
+            dst[1] = vg >> shift;
+            dst[b] = vb >> shift;
+            dst[3] = d->keyed && vr == d->key[0] && vg == d->key[1] && vb == d->key[2] ? 0 : 255;
+        }
+        break;
+    case 3:
+        for (unsigned x = 0; x < d->pw; x++, dst += step) {
+            const unsigned char *color = d->palette[sample(src, x, depth)];
+            dst[r] = color[0];
+            dst[1] = color[1];
+            dst[b] = color[2];
+            dst[3] = color[3];
+        }
+        break;
+    case 4:
+        for (unsigned x = 0; x < d->pw; x++, dst += step) {
+            dst[0] = dst[1] = dst[2] = sample(src, 2 * (size_t)x, depth) >> shift;
+            dst[3] = sample(src, 2 * (size_t)x + 1, depth) >> shift;
+        }
+        break;
+    case 6:
+        if (depth == 8) {
+            // Most inputs are 8-bit RGBA, so they get a loop of their own.
+            for (unsigned x = 0; x < d->pw; x++, dst += step, src += 4) {
+                dst[r] = src[0];
+                dst[1] = src[1];
+                dst[b] = src[2];
+                dst[3] = src[3];
+            }
+            break;
+        }
+        for (unsigned x = 0; x < d->pw; x++, dst += step) {
+            dst[r] = sample(src, 4 * (size_t)x, depth) >> shift;
+            dst[1] = sample(src, 4 * (size_t)x + 1, depth) >> shift;
+            dst[b] = sample(src, 4 * (size_t)x + 2, depth) >> shift;
+            dst[3] = sample(src, 4 * (size_t)x + 3, depth) >> shift;
+        }
+        break;
+    }
+}
+
+/**
+ * [inflate_rows d z in n ended] inflates the [n] bytes at [in] with [z],
+ * decoding every row of [d] they complete. [ended] is set once the end of the
+ * zlib stream is reached. Returns [false] if the data is corrupt.
+ */
+static bool
+inflate_rows(struct decoder *d, z_stream *z, const unsigned char *in, size_t n, bool *ended)
+{
+    z->next_in = (Bytef *)in;
+    z->avail_in = n;
+
+    while (d->pass < d->npasses) {
+        size_t want = d->rowbytes + 1 - d->filled;
+        uInt avail = want < UINT32_MAX ? want : UINT32_MAX;
+        z->next_out = d->cur + d->filled;
+        z->avail_out = avail;
+
+        int result = inflate(z, Z_NO_FLUSH);
+        d->filled += avail - z->avail_out;
+
+        if (d->filled == d->rowbytes + 1) {
+            if (!unfilter(d->cur + 1, d->prev + 1, d->rowbytes, d->bytes, d->cur[0]))
+                return false;
+            store(d, d->cur + 1);
+
+            unsigned char *swap = d->prev;
+            d->prev = d->cur;
+            d->cur = swap;
+            d->filled = 0;
+
+            if (++d->y == d->ph) {
+                d->pass++;
+                pass_begin(d);
+            }
+        }
+
+        if (result == Z_STREAM_END) {
+            *ended = true;
+            return true;
+        }
+        if (result == Z_BUF_ERROR)
+            return true;
+        if (result != Z_OK)
+            return false;
+        // With room left for output, inflate only stops once it has used up
+        // its input.
+        if (z->avail_in == 0 && z->avail_out > 0)
+            return true;
+    }
+
+    // Anything after the last row is ignored.
+    return true;
+}
+
+bool
+decode_png(const char *path, unsigned char *row, ptrdiff_t pitch, unsigned w, unsigned h, bool bgra)
+{
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
+        return false;
+
+    bool ok = false;
+
+    struct decoder d;
+    d.cur = NULL;
+    d.prev = NULL;
+    unsigned char *in = NULL;
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    bool inflating = false;
+
+    if (!read_header(stream, &d.hdr) || d.hdr.w != w || d.hdr.h != h)
+        goto close;
+
+    static const unsigned channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    d.channels = channels[d.hdr.color];
+    d.bytes = d.channels * d.hdr.depth < 8 ? 1 : d.channels * d.hdr.depth / 8;
+    for (unsigned i = 0; i < 256; i++) {
+        d.palette[i][0] = d.palette[i][1] = d.palette[i][2] = 0;
+        d.palette[i][3] = 255;
+    }
+    d.keyed = false;
+
+    d.passes = d.hdr.interlaced ? adam7 : &whole;
+    d.npasses = d.hdr.interlaced ? 7 : 1;
+    d.row = row;
+    d.pitch = pitch;
+    d.bgra = bgra;
+
+    // The widest row is that of the whole image, even when interlaced.
+    size_t rowbytes = ((size_t)w * d.channels * d.hdr.depth + 7) / 8;
+    d.cur = malloc(rowbytes + 1);
+    assert(d.cur != NULL);
+    d.prev = malloc(rowbytes + 1);
+    assert(d.prev != NULL);
+    in = malloc(READ_CHUNK);
+    assert(in != NULL);
+
+    d.pass = 0;
+    pass_begin(&d);
+
+    if (inflateInit(&z) != Z_OK)
+        goto close;
+    inflating = true;
+
+    bool plte = false;
+    bool ended = false;
+    for (;;) {
+        unsigned char head[8];
+        if (fread(head, 1, sizeof(head), stream) != sizeof(head))
+            goto close;
+        uint32_t len = get32(head);
+        const unsigned char *type = head + 4;
+        if (len > MAX_SIDE)
+            goto close;
+
+        if (!memcmp(type, "IDAT", 4)) {
+            if (d.hdr.color == 3 && !plte)
+                goto close;
+            while (len > 0) {
+                size_t n = len < READ_CHUNK ? len : READ_CHUNK;
+                if (fread(in, 1, n, stream) != n)
+                    goto close;
+                len -= n;
+                if (!ended && !inflate_rows(&d, &z, in, n, &ended))
+                    goto close;
+            }
+        } else if (!memcmp(type, "PLTE", 4)) {
+            unsigned char buf[3 * 256];
+            if (len == 0 || len % 3 || len > sizeof(buf) || fread(buf, 1, len, stream) != len)
+                goto close;
+            for (unsigned i = 0; i < len / 3; i++)
+                memcpy(d.palette[i], buf + 3 * i, 3);
+            plte = true;
+        } else if (!memcmp(type, "tRNS", 4)) {
+            unsigned char buf[256];
+            if (len > sizeof(buf) || fread(buf, 1, len, stream) != len)
+                goto close;
+            // Like libpng, ignore a tRNS chunk of the wrong size.
+            if (d.hdr.color == 3) {
+                for (unsigned i = 0; i < len; i++)
+                    d.palette[i][3] = buf[i];
+            } else if ((d.hdr.color == 0 && len == 2) || (d.hdr.color == 2 && len == 6)) {
+                d.keyed = true;
+                for (unsigned i = 0; i < len / 2; i++)
+                    d.key[i] = buf[2 * i] << 8 | buf[2 * i + 1];
+            }
+        } else if (!memcmp(type, "IEND", 4)) {
+            break;
+        } else {
+            // Unknown chunks can be skipped, unless they're critical.
+            if (!(type[0] & 0x20) || fseek(stream, len, SEEK_CUR))
+                goto close;
+        }
+
+        // CRCs aren't checked: the zlib stream has its own checksum.
+        if (fseek(stream, 4, SEEK_CUR))
+            goto close;
+    }
+
+    ok = d.pass == d.npasses;
+
+close:
+    if (inflating)
+        inflateEnd(&z);
+    free(in);
+    free(d.cur);
+    free(d.prev);
+    fclose(stream);
+    return ok;
+}
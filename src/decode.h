@@ -0,0 +1,29 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * [decode_probe path w h] stores the dimensions of the PNG at [path] into [w]
+ * and [h], reading nothing past its IHDR chunk. Returns [false] if the file
+ * can't be read or doesn't start like a PNG.
+ */
+bool decode_probe(const char *path, unsigned *w, unsigned *h);
+
+/**
+ * [decode_png path row pitch w h bgra] decodes the [w] by [h] PNG at [path]
+ * into 32-bit pixels, stored as R, G, B, A bytes, or as B, G, R, A if [bgra]
+ * is set. [row] points to where the top row of the image goes, and each row
+ * goes [pitch] bytes after the one above it, so the image can be decoded
+ * straight into its place in a larger, possibly bottom-up, image.
+ * Every color type, bit depth and interlacing of PNG is supported. Grey and
+ * palette images are expanded to RGB, [tRNS] chunks become alpha, and 16-bit
+ * samples keep their high byte. Rows are decoded as the file is read, so no
+ * more than two rows of the PNG are held in memory at once.
+ * Returns [false] if the file can't be read, isn't a [w] by [h] PNG or is
+ * corrupt, in which case the rows of the image may have been partly written.
+ */
+bool decode_png(const char *path, unsigned char *row, ptrdiff_t pitch, unsigned w, unsigned h, bool bgra);
+
+#endif
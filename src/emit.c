@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "emit.h"
+
+/**
+ * [COMPARE_CHUNK] is how many bytes of an existing file are read at a time to
+ * compare it with new contents.
+ */
+#define COMPARE_CHUNK (1 << 16)
+
+/**
+ * [mask] is the process's umask, as read by [emit_init].
+ */
+static mode_t mask = 022;
+
+void
+emit_init()
+{
+    mask = umask(0);
+    umask(mask);
+}
+
+bool
+emit_open(struct emit *e)
+{
+    e->buf = NULL;
+    e->len = 0;
+    e->stream = open_memstream(&e->buf, &e->len);
+    if (e->stream == NULL) {
+        fprintf(stderr, "emit_open: open_memstream: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void
+emit_abort(struct emit *e)
+{
+    fclose(e->stream);
+    free(e->buf);
+}
+
+/**
+ * [same path buf len] returns [true] iff the file at [path] holds exactly the
+ * [len] bytes at [buf].
+ */
+static bool
+same(const char *path, const char *buf, size_t len)
+{
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
+        return false;
+
+    bool equal = false;
+
+    struct stat st;
+    if (fstat(fileno(stream), &st) || (size_t)st.st_size != len)
+        goto close;
+
+    char *chunk = malloc(COMPARE_CHUNK);
+    assert(chunk != NULL);
+
+    size_t at = 0;
+    size_t n;
+    while ((n = fread(chunk, 1, COMPARE_CHUNK, stream)) > 0) {
+        if (at + n > len || memcmp(chunk, buf + at, n))
+            break;
+        at += n;
+    }
+    equal = at == len && !ferror(stream);
+
+    free(chunk);
+
+close:
+    fclose(stream);
+    return equal;
+}
+
+bool
+emit_close(struct emit *e, const char *path)
+{
+    if (fclose(e->stream)) {
+        fprintf(stderr, "emit_close: failed to print %s: %s\n", path, strerror(errno));
+        free(e->buf);
+        return false;
+    }
+
+    if (same(path, e->buf, e->len)) {
+        free(e->buf);
+        return true;
+    }
+
+    char *tmp = malloc(strlen(path) + 8); // appending {.XXXXXX, \0}
+    assert(tmp != NULL);
+    sprintf(tmp, "%s.XXXXXX", path);
+
+    bool ok = false;
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        fprintf(stderr, "emit_close: mkstemp: failed to create %s: %s\n", tmp, strerror(errno));
+        goto close;
+    }
+
+    // mkstemp makes files only their owner can read, but generated code
+    // should get the same permissions as any other new file.
+    ok = true;
+    for (size_t at = 0; ok && at < e->len;) {
+        ssize_t n = write(fd, e->buf + at, e->len - at);
+        if (n < 0 && errno != EINTR)
+            ok = false;
+        if (n > 0)
+            at += n;
+    }
+    if (!ok || fchmod(fd, 0666 & ~mask) || fsync(fd)) {
+        fprintf(stderr, "emit_close: failed to write %s: %s\n", tmp, strerror(errno));
+        ok = false;
+    }
+    if (close(fd)) {
+        fprintf(stderr, "emit_close: close: %s\n", strerror(errno));
+        ok = false;
+    }
+    if (ok && rename(tmp, path)) {
+        fprintf(stderr, "emit_close: rename: failed to move %s to %s: %s\n", tmp, path, strerror(errno));
+        ok = false;
+    }
+
+    if (!ok)
+        unlink(tmp);
+
+close:
+    free(tmp);
+    free(e->buf);
+    return ok;
+}
@@ -0,0 +1,47 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * An [emit] collects the contents of a generated file in memory, so that the
+ * file can be replaced all at once, and only if its contents changed. Files
+ * that stay the same keep their modification times, so build systems don't
+ * rebuild what depends on them, and a failure halfway through leaves the old
+ * file as it was.
+ */
+struct emit {
+    FILE *stream; //!< [stream] is where the contents are printed to.
+    char *buf; //!< [buf] holds the [len] bytes printed so far, once [stream] is flushed.
+    size_t len;
+};
+
+/**
+ * [emit_init] reads the process's umask, which [emit_close] gives generated
+ * files the permissions of. Reading it means setting it, so this must be
+ * called before any other thread starts creating files.
+ */
+void emit_init();
+
+/**
+ * [emit_open e] opens [e->stream] for printing. Returns [false] (after
+ * printing an error) on failure.
+ */
+bool emit_open(struct emit *e);
+
+/**
+ * [emit_close e path] closes [e->stream] and writes what was printed to it
+ * to [path], unless [path] holds exactly that already. The new contents are
+ * written to a temporary file that is then renamed over [path]. Returns
+ * [false] (after printing an error) on failure, leaving [path] untouched.
+ */
+bool emit_close(struct emit *e, const char *path);
+
+/**
+ * [emit_abort e] closes [e->stream] and discards what was printed to it.
+ */
+void emit_abort(struct emit *e);
+
+#endif
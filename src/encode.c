@@ -0,0 +1,464 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "pool.h"
+#include "encode.h"
+#include "trace.h"
+
+/**
+ * [BAND_BYTES] is roughly how many bytes of filtered rows go into each band.
+ * Bands are compressed independently, but each is primed with the [WINDOW]
+ * bytes of filtered rows before it, so matches reach back as far as they
+ * would in a single stream. Splitting the image only costs the few bytes
+ * each flush takes.
+ */
+#define BAND_BYTES (1 << 20)
+
+/**
+ * [WINDOW] is the size of deflate's window: no match reaches back further.
+ */
+#define WINDOW (1 << 15)
+
+/**
+ * A [band] is a run of rows of the image that are filtered and deflated
+ * together, into [out].
+ */
+struct band {
+    unsigned from; //!< [from] is the first row of the band.
+    unsigned to; //!< [to] is one past the last row of the band.
+    unsigned char *out; //!< [out] holds the band's part of the zlib stream.
+    size_t len; //!< [len] is the number of bytes in [out].
+    size_t cap; //!< [cap] is the number of bytes allocated for [out].
+    uLong adler; //!< [adler] is the Adler-32 checksum of the band's filtered rows.
+    size_t raw; //!< [raw] is the number of bytes of filtered rows in the band.
+};
+
+/**
+ * An [encodework] is the context shared by the tasks that encode the
+ * [bands] of an image. See [encode_png] for the other fields.
+ */
+struct encodework {
+    const unsigned char *row;
+    ptrdiff_t pitch;
+    unsigned w;
+    unsigned h;
+    bool bgra;
+    const struct encodeopts *opts;
+
+    size_t rowbytes; //!< [rowbytes] is the length of a filtered row: a filter type byte and 4 per pixel.
+    struct band *bands;
+    unsigned nbands;
+};
+
+/**
+ * The PNG row filters. See the PNG specification, section 9.
+ */
+enum filter {
+    FILTER_NONE,
+    FILTER_SUB,
+    FILTER_UP,
+    FILTER_AVERAGE,
+    FILTER_PAETH,
+    FILTERS
+};
+
+static inline unsigned char
+paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/**
+ * [choose cur prev n] returns the filter whose output for the [n]-byte row
+ * [cur] below [prev] has the least sum of absolute values, read as signed
+ * bytes. It's the heuristic the PNG specification recommends.
+ */
+static enum filter
+choose(const unsigned char *cur, const unsigned char *prev, size_t n)
+{
+    unsigned long sums[FILTERS] = { 0 };
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned char a = i >= 4 ? cur[i - 4] : 0;
+        unsigned char b = prev[i];
+        unsigned char c = i >= 4 ? prev[i - 4] : 0;
+
+        signed char r[FILTERS] = {
+            cur[i],
+            cur[i] - a,
+            cur[i] - b,
+            cur[i] - ((a + b) >> 1),
+            cur[i] - paeth(a, b, c),
+        };
+        for (int f = 0; f < FILTERS; f++) {
+            sums[f] += r[f] < 0 ? -r[f] : r[f];
+        }
+    }
+
+    enum filter best = FILTER_NONE;
+    for (int f = 1; f < FILTERS; f++) {
+        if (sums[f] < sums[best])
+            best = f;
+    }
+    return best;
+}
+
+/**
+ * [apply filter cur prev n dst] stores the [n]-byte row [cur] below [prev],
+ * filtered with [filter], into [dst].
+ */
+static void
+apply(enum filter filter, const unsigned char *cur, const unsigned char *prev, size_t n, unsigned char *dst)
+{
+    // The first pixel has nothing to its left.
+    size_t i = 0;
+    switch (filter) {
+    case FILTER_NONE:
+        memcpy(dst, cur, n);
+        break;
+    case FILTER_SUB:
+        for (; i < 4 && i < n; i++)
+            dst[i] = cur[i];
+        for (; i < n; i++)
+            dst[i] = cur[i] - cur[i - 4];
+        break;
+    case FILTER_UP:
+        for (; i < n; i++)
+            dst[i] = cur[i] - prev[i];
+        break;
+    case FILTER_AVERAGE:
+        for (; i < 4 && i < n; i++)
+            dst[i] = cur[i] - (prev[i] >> 1);
+        for (; i < n; i++)
+            dst[i] = cur[i] - ((cur[i - 4] + prev[i]) >> 1);
+        break;
+    default:
+        for (; i < 4 && i < n; i++)
+            dst[i] = cur[i] - paeth(0, prev[i], 0);
+        for (; i < n; i++)
+            dst[i] = cur[i] - paeth(cur[i - 4], prev[i], prev[i - 4]);
+        break;
+    }
+}
+
+/**
+ * [rgba work y dst] stores row [y] of the image of [work] into [dst] as R, G,
+ * B, A bytes.
+ */
+static void
+rgba(const struct encodework *work, unsigned y, unsigned char *dst)
+{
+    const unsigned char *src = work->row + (ptrdiff_t)y * work->pitch;
+    size_t n = 4 * (size_t)work->w;
+
+    if (!work->bgra) {
+        memcpy(dst, src, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i += 4) {
+        dst[i] = src[i + 2];
+        dst[i + 1] = src[i + 1];
+        dst[i + 2] = src[i];
+        dst[i + 3] = src[i + 3];
+    }
+}
+
+/**
+ * [filter_rows work from to dst] filters the rows [from, to) of the image of
+ * [work] into [dst], which must hold [(to - from) * work->rowbytes] bytes.
+ */
+static void
+filter_rows(const struct encodework *work, unsigned from, unsigned to, unsigned char *dst)
+{
+    size_t n = 4 * (size_t)work->w;
+
+    unsigned char *prev = calloc(2 * n + 1, 1);
+    assert(prev != NULL);
+    unsigned char *cur = prev + n;
+    unsigned char *rows = prev;
+
+    if (from > 0)
+        rgba(work, from - 1, prev);
+
+    // Trying every filter on every row takes about as long as fast
+    // compression itself, so fast levels stick to one filter that does well
+    // on most images, and level 0 doesn't filter at all.
+    int level = work->opts->level;
+
+    for (unsigned y = from; y < to; y++) {
+        rgba(work, y, cur);
+
+        enum filter filter = level == 0 ? FILTER_NONE : level <= 2 ? FILTER_UP : choose(cur, prev, n);
+        dst[0] = filter;
+        apply(filter, cur, prev, n, dst + 1);
+        dst += work->rowbytes;
+
+        unsigned char *t = prev;
+        prev = cur;
+        cur = t;
+    }
+
+    free(rows);
+}
+
+/**
+ * [encode_band ctx b] filters and deflates the [b]th band of the
+ * [encodework] [ctx] into its [out]. It is intended for use with [pool_for].
+ */
+static void
+encode_band(void *ctx, unsigned b)
+{
+    struct encodework *work = ctx;
+    struct band *band = &work->bands[b];
+
+    struct timespec start;
+    trace_begin(&start);
+
+    // The rows before the band that fill the window are filtered too, but
+    // only to prime the compressor with.
+    unsigned prime = (WINDOW + work->rowbytes - 1) / work->rowbytes;
+    if (prime > band->from)
+        prime = band->from;
+
+    size_t primed = prime * work->rowbytes;
+    band->raw = (band->to - band->from) * work->rowbytes;
+
+    unsigned char *raw = malloc(primed + band->raw + 1);
+    assert(raw != NULL);
+    filter_rows(work, band->from - prime, band->to, raw);
+
+    band->adler = adler32(adler32(0, Z_NULL, 0), raw + primed, band->raw);
+
+    // Each band is a raw deflate stream, so that they can be concatenated.
+    // All but the last end with a sync flush, which ends on a byte boundary
+    // without marking the end of the stream; the last one does.
+    z_stream z;
+    z.zalloc = Z_NULL;
+    z.zfree = Z_NULL;
+    z.opaque = Z_NULL;
+    int ret = deflateInit2(&z, work->opts->level, Z_DEFLATED, -15, 8, work->opts->strategy);
+    assert(ret == Z_OK);
+
+    if (primed > 0) {
+        size_t dict = primed < WINDOW ? primed : WINDOW;
+        ret = deflateSetDictionary(&z, raw + primed - dict, dict);
+        assert(ret == Z_OK);
+    }
+
+    // The first band starts with the zlib header, and the last leaves room
+    // for the Adler-32 trailer, which can only be worked out once every band
+    // is done.
+    bool first = b == 0;
+    bool last = b + 1 == work->nbands;
+    band->cap = deflateBound(&z, band->raw) + 16;
+    band->out = malloc(band->cap);
+    assert(band->out != NULL);
+    band->len = 0;
+
+    if (first) {
+        int level = work->opts->level;
+        unsigned cmf = 0x78; // deflate with a 32 KiB window
+        unsigned flg = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+        flg += 31 - (cmf << 8 | flg) % 31;
+        band->out[band->len++] = cmf;
+        band->out[band->len++] = flg;
+    }
+
+    z.next_in = raw + primed;
+    z.avail_in = band->raw;
+    int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    for (;;) {
+        if (band->len + 4 >= band->cap) {
+            band->cap *= 2;
+            band->out = realloc(band->out, band->cap);
+            assert(band->out != NULL);
+        }
+        z.next_out = band->out + band->len;
+        z.avail_out = band->cap - band->len - 4;
+
+        ret = deflate(&z, flush);
+        assert(ret != Z_STREAM_ERROR);
+        band->len = z.next_out - band->out;
+
+        if (last ? ret == Z_STREAM_END : z.avail_in == 0 && z.avail_out > 0)
+            break;
+    }
+
+    deflateEnd(&z);
+    free(raw);
+
+    trace_end(&start, "band", "deflate", NULL, "\"band\": %u, \"rows\": %u, \"bytes\": %zu", b,
+            band->to - band->from, band->len);
+}
+
+static void
+put32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/**
+ * [chunk stream type data len] writes a PNG chunk of type [type] holding the
+ * [len] bytes at [data] to [stream].
+ */
+static void
+chunk(FILE *stream, const char *type, const unsigned char *data, size_t len)
+{
+    unsigned char head[8];
+    put32(head, len);
+    memcpy(head + 4, type, 4);
+
+    uLong crc = crc32(0, Z_NULL, 0);
+    crc = crc32(crc, head + 4, 4);
+
+    fwrite(head, 1, sizeof(head), stream);
+    // IEND has no data, and crc32 would take a null [data] as a request for
+    // its initial value.
+    if (len > 0) {
+        crc = crc32(crc, data, len);
+        fwrite(data, 1, len, stream);
+    }
+
+    unsigned char tail[4];
+    put32(tail, crc);
+    fwrite(tail, 1, sizeof(tail), stream);
+}
+
+bool
+encode_parse(struct encodeopts *opts, const char *value)
+{
+    char level[16];
+    char strategy[16] = "default";
+    char extra;
+
+    // Levels and strategies may also be separated by a comma, which is
+    // easier to pass on the command line.
+    char buf[64];
+    if (strlen(value) >= sizeof(buf))
+        return false;
+    strcpy(buf, value);
+    char *comma = strchr(buf, ',');
+    if (comma != NULL)
+        *comma = ' ';
+
+    int n = sscanf(buf, "%15s %15s %c", level, strategy, &extra);
+    if (n < 1 || n > 2)
+        return false;
+
+    if (!strcmp(level, "fast"))
+        opts->level = 1;
+    else if (!strcmp(level, "default"))
+        opts->level = 6;
+    else if (!strcmp(level, "max"))
+        opts->level = 9;
+    else if (strlen(level) == 1 && level[0] >= '0' && level[0] <= '9')
+        opts->level = level[0] - '0';
+    else
+        return false;
+
+    if (!strcmp(strategy, "default"))
+        opts->strategy = Z_DEFAULT_STRATEGY;
+    else if (!strcmp(strategy, "filtered"))
+        opts->strategy = Z_FILTERED;
+    else if (!strcmp(strategy, "rle"))
+        opts->strategy = Z_RLE;
+    else if (!strcmp(strategy, "huffman"))
+        opts->strategy = Z_HUFFMAN_ONLY;
+    else
+        return false;
+
+    return true;
+}
+
+bool
+encode_png(struct pool *pool, const char *path, const unsigned char *row, ptrdiff_t pitch,
+        unsigned w, unsigned h, bool bgra, const struct encodeopts *opts)
+{
+    struct encodework work = { row, pitch, w, h, bgra, opts, 1 + 4 * (size_t)w, NULL, 0 };
+
+    // Bands are cut by size alone, so the output is the same however many
+    // jobs there are.
+    unsigned rows = BAND_BYTES / work.rowbytes;
+    if (rows == 0)
+        rows = 1;
+    work.nbands = h == 0 ? 1 : (h + rows - 1) / rows;
+
+    work.bands = malloc(work.nbands * sizeof(struct band));
+    assert(work.bands != NULL);
+    for (unsigned b = 0; b < work.nbands; b++) {
+        work.bands[b].from = b * rows;
+        work.bands[b].to = b + 1 == work.nbands ? h : (b + 1) * rows;
+    }
+
+    pool_for(pool, work.nbands, encode_band, &work);
+
+    // The zlib trailer is the Adler-32 checksum of all of the filtered rows.
+    uLong adler = work.bands[0].adler;
+    for (unsigned b = 1; b < work.nbands; b++) {
+        adler = adler32_combine(adler, work.bands[b].adler, work.bands[b].raw);
+    }
+    struct band *last = &work.bands[work.nbands - 1];
+    put32(last->out + last->len, adler);
+    last->len += 4;
+
+    bool ok = false;
+
+    FILE *stream = fopen(path, "wb");
+    if (stream == NULL) {
+        fprintf(stderr, "encode_png: fopen: failed to open file at %s for writing: %s\n", path, strerror(errno));
+        goto close;
+    }
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, sizeof(signature), stream);
+
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlacing.
+    unsigned char ihdr[13];
+    put32(ihdr, w);
+    put32(ihdr + 4, h);
+    ihdr[8] = 8;
+    ihdr[9] = 6;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    chunk(stream, "IHDR", ihdr, sizeof(ihdr));
+
+    // The zlib stream may be split across IDAT chunks anywhere, so each band
+    // gets its own.
+    for (unsigned b = 0; b < work.nbands; b++) {
+        chunk(stream, "IDAT", work.bands[b].out, work.bands[b].len);
+    }
+
+    chunk(stream, "IEND", NULL, 0);
+
+    ok = !ferror(stream);
+    if (fclose(stream))
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "encode_png: failed to write %s: %s\n", path, strerror(errno));
+
+close:
+    for (unsigned b = 0; b < work.nbands; b++) {
+        free(work.bands[b].out);
+    }
+    free(work.bands);
+    return ok;
+}
@@ -0,0 +1,39 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pool.h"
+
+/**
+ * An [encodeopts] selects how [encode_png] compresses an image.
+ */
+struct encodeopts {
+    int level; //!< [level] is the zlib compression level, from 0 (store) to 9 (smallest).
+    int strategy; //!< [strategy] is the zlib strategy, e.g. [Z_DEFAULT_STRATEGY] or [Z_RLE].
+};
+
+/**
+ * [encode_parse opts value] parses [value], of the form "<level> [<strategy>]"
+ * where <level> is "fast", "default", "max" or a digit and <strategy> is one
+ * of "default", "filtered", "rle" or "huffman", into [opts]. Returns [false]
+ * if [value] isn't of that form.
+ */
+bool encode_parse(struct encodeopts *opts, const char *value);
+
+/**
+ * [encode_png pool path row pitch w h bgra opts] writes the [w] by [h] image of
+ * 32-bit pixels to [path] as an 8-bit RGBA PNG compressed according to
+ * [opts]. [row] points to the top row of the image, and each row starts
+ * [pitch] bytes after the one above it, so bottom-up images can be passed
+ * with a negative [pitch]. Pixels are stored as R, G, B, A bytes, or as B, G,
+ * R, A if [bgra] is set.
+ * The image is cut into bands of rows that are filtered and deflated in
+ * parallel on [pool], and the output doesn't depend on the number of jobs.
+ * Returns [false] (after printing an error) on failure.
+ */
+bool encode_png(struct pool *pool, const char *path, const unsigned char *row, ptrdiff_t pitch,
+        unsigned w, unsigned h, bool bgra, const struct encodeopts *opts);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <assert.h>
+
+#include "pack.h"
+#include "frontier.h"
+
+/**
+ * [FRONTIER_MIN_CAP] is the number of keys allocated the first time a
+ * [frontier] grows.
+ */
+#define FRONTIER_MIN_CAP 64
+
+/**
+ * [frontier_key p] packs [p] into a key that sorts in frontier order.
+ *
+ * Let [m] be the maximum of x and y. The positions with that maximum form an
+ * L-shaped ring, (0, m), (1, m), ..., (m - 1, m), then (m, 0), (m, 1), ...,
+ * (m, m) in frontier order. A position's index along the ring is x if x < m
+ * and m + y otherwise, which is less than 2^32, so [m] goes in the top 31 bits
+ * and the index in the 33 bits below.
+ */
+static inline uint64_t
+frontier_key(struct posn p)
+{
+    uint64_t m = p.x > p.y ? p.x : p.y;
+    uint64_t r = p.x < m ? p.x : m + p.y;
+
+    return m << 33 | r;
+}
+
+static inline struct posn
+frontier_posn(uint64_t key)
+{
+    unsigned m = key >> 33;
+    uint64_t r = key & (((uint64_t)1 << 33) - 1);
+
+    struct posn p;
+    if (r < m) {
+        p.x = r;
+        p.y = m;
+    } else {
+        p.x = m;
+        p.y = r - m;
+    }
+    return p;
+}
+
+void
+frontier_init(struct frontier *frontier)
+{
+    frontier->keys = NULL;
+    frontier->len = 0;
+    frontier->cap = 0;
+    frontier->pushes = 0;
+    frontier->allocs = 0;
+    frontier->peak = 0;
+}
+
+void
+frontier_free(struct frontier *frontier)
+{
+    free(frontier->keys);
+    frontier->keys = NULL;
+    frontier->len = 0;
+    frontier->cap = 0;
+}
+
+void
+frontier_reserve(struct frontier *frontier, size_t n)
+{
+    if (n <= frontier->cap)
+        return;
+
+    frontier->keys = realloc(frontier->keys, n * sizeof(uint64_t));
+    assert(frontier->keys != NULL);
+    frontier->cap = n;
+    frontier->allocs++;
+}
+
+void
+frontier_push(struct frontier *frontier, struct posn p)
+{
+    assert(p.x <= FRONTIER_MAX && p.y <= FRONTIER_MAX);
+
+    frontier->pushes++;
+
+    if (frontier->len == frontier->cap) {
+        frontier_reserve(frontier, frontier->cap < FRONTIER_MIN_CAP ? FRONTIER_MIN_CAP : 2 * frontier->cap);
+    }
+
+    uint64_t *keys = frontier->keys;
+    uint64_t key = frontier_key(p);
+
+    // Sift up: move parents down until the new key's place is found.
+    size_t i = frontier->len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 4;
+        if (keys[parent] <= key)
+            break;
+        keys[i] = keys[parent];
+        i = parent;
+    }
+    keys[i] = key;
+
+    if (frontier->len > frontier->peak)
+        frontier->peak = frontier->len;
+}
+
+struct posn
+frontier_pop(struct frontier *frontier)
+{
+    assert(frontier->len > 0);
+
+    uint64_t *keys = frontier->keys;
+    uint64_t top = keys[0];
+    uint64_t key = keys[--frontier->len];
+    size_t len = frontier->len;
+
+    // Sift down the last key from the root: move the smallest child up until
+    // none is smaller than it.
+    size_t i = 0;
+    for (;;) {
+        size_t first = 4 * i + 1;
+        if (first >= len)
+            break;
+
+        size_t last = first + 4 < len ? first + 4 : len;
+        size_t min = first;
+        for (size_t c = first + 1; c < last; c++) {
+            if (keys[c] < keys[min])
+                min = c;
+        }
+
+        if (keys[min] >= key)
+            break;
+        keys[i] = keys[min];
+        i = min;
+    }
+    if (len > 0)
+        keys[i] = key;
+
+    return frontier_posn(top);
+}
@@ -0,0 +1,58 @@
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pack.h"
+
+/**
+ * A [frontier] is a min-priority queue of [posn]s, ordered first by the
+ * maximum of x and y, then by x, then by y. This is the order the frontier
+ * heuristic tries positions in.
+ *
+ * Positions are stored inline as 64-bit keys whose integer order is the
+ * queue's order (see [frontier_key]), in a 4-ary heap: comparisons are plain
+ * integer comparisons, and the four children of a node share a cache line.
+ * Storage grows geometrically and can be set aside up front with
+ * [frontier_reserve].
+ * Frontiers are set up with [frontier_init] and their storage freed with
+ * [frontier_free].
+ */
+struct frontier {
+    uint64_t *keys; //!< [keys] is the heap, with the children of [keys[i]] at [keys[4 * i + 1]] to [keys[4 * i + 4]].
+    size_t len; //!< [len] is the number of positions in the queue.
+    size_t cap; //!< [cap] is the number of keys there is room for in [keys].
+
+    unsigned long pushes; //!< [pushes] counts the calls to [frontier_push].
+    unsigned long allocs; //!< [allocs] counts the times [keys] was (re)allocated.
+    size_t peak; //!< [peak] is the largest [len] has been.
+};
+
+/**
+ * [FRONTIER_MAX] is the largest coordinate a [frontier] can hold.
+ */
+#define FRONTIER_MAX 0x7fffffffu
+
+void frontier_init(struct frontier *frontier);
+void frontier_free(struct frontier *frontier);
+
+/**
+ * [frontier_reserve frontier n] makes room for [n] positions in total, so that
+ * pushes don't allocate until the queue holds more than that.
+ */
+void frontier_reserve(struct frontier *frontier, size_t n);
+
+/**
+ * [frontier_push frontier p] adds [p] to the queue. Both coordinates must be
+ * at most [FRONTIER_MAX].
+ */
+void frontier_push(struct frontier *frontier, struct posn p);
+
+/**
+ * [frontier_pop frontier] removes and returns the first position in the queue,
+ * which must not be empty.
+ */
+struct posn frontier_pop(struct frontier *frontier);
+
+#endif
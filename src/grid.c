@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include "grid.h"
+
+/**
+ * [GRID_MIN_SIDE] is the side length of a fresh grid: one word per row.
+ */
+#define GRID_MIN_SIDE 64
+
+/**
+ * [span_mask lo hi] returns the mask of bits [lo, hi] of a word, where
+ * [lo <= hi < 64].
+ */
+static inline uint64_t
+span_mask(unsigned lo, unsigned hi)
+{
+    return (~(uint64_t)0 << lo) & (~(uint64_t)0 >> (63 - hi));
+}
+
+/*
+ * The occupancy index is the usual "range update, range query" pair of 2D
+ * Fenwick trees over the difference array d of the marked positions: each
+ * node holds the sums of d, d * x, d * y and d * x * y over the range it
+ * covers, from which the number of marked positions in any prefix rectangle
+ * follows (see [index_prefix]). Marking a rectangle is four point updates of
+ * d, so both operations are O(log^2 s).
+ * All arithmetic is modulo 2^32. Intermediate values wrap, but the counts we
+ * compute are at most s * s, which always fits.
+ */
+
+static inline uint32_t (*index_node(struct grid *grid, unsigned x, unsigned y))[4]
+{
+    return &grid->index[(size_t)x * (grid->s + 1) + y];
+}
+
+/**
+ * [index_add grid x y v] adds [v] to d(x, y), with 1-based coordinates.
+ */
+static void
+index_add(struct grid *grid, unsigned x, unsigned y, uint32_t v)
+{
+    for (unsigned i = x; i <= grid->s; i += i & -i) {
+        for (unsigned j = y; j <= grid->s; j += j & -j) {
+            uint32_t *n = *index_node(grid, i, j);
+            n[0] += v;
+            n[1] += v * x;
+            n[2] += v * y;
+            n[3] += v * x * y;
+        }
+    }
+}
+
+/**
+ * [index_prefix grid x y] returns the number of marked positions in
+ * [1, x] × [1, y], with 1-based coordinates.
+ */
+static uint32_t
+index_prefix(struct grid *grid, unsigned x, unsigned y)
+{
+    uint32_t a = 0, b = 0, c = 0, d = 0;
+
+    for (unsigned i = x; i > 0; i -= i & -i) {
+        for (unsigned j = y; j > 0; j -= j & -j) {
+            const uint32_t *n = *index_node(grid, i, j);
+            a += n[0];
+            b += n[1];
+            c += n[2];
+            d += n[3];
+        }
+    }
+
+    return a * (x + 1) * (y + 1) - b * (y + 1) - c * (x + 1) + d;
+}
+
+/**
+ * [index_fill grid x y w h] records that the rectangle [x, x + w) ×
+ * [y, y + h) has been marked. It must not overlap anything already marked.
+ */
+static void
+index_fill(struct grid *grid, unsigned x, unsigned y, unsigned w, unsigned h)
+{
+    index_add(grid, x + 1, y + 1, 1);
+    index_add(grid, x + 1, y + h + 1, -1);
+    index_add(grid, x + w + 1, y + 1, -1);
+    index_add(grid, x + w + 1, y + h + 1, 1);
+}
+
+/**
+ * [index_build grid] (re)builds [grid->index] from the bitset in O(s^2).
+ */
+static void
+index_build(struct grid *grid)
+{
+    size_t n = (size_t)(grid->s + 1) * (grid->s + 1);
+
+    free(grid->index);
+    grid->index = calloc(n, sizeof(*grid->index));
+    assert(grid->index != NULL);
+
+    // Start with d itself in every node...
+    for (unsigned x = 1; x <= grid->s; x++) {
+        for (unsigned y = 1; y <= grid->s; y++) {
+            uint32_t v = grid_marked(grid, x - 1, y - 1)
+                - grid_marked(grid, x - 2, y - 1)
+                - grid_marked(grid, x - 1, y - 2)
+                + grid_marked(grid, x - 2, y - 2);
+            if (v == 0)
+                continue;
+
+            uint32_t *n = *index_node(grid, x, y);
+            n[0] = v;
+            n[1] = v * x;
+            n[2] = v * y;
+            n[3] = v * x * y;
+        }
+    }
+
+    // ...then push every node into its parent, first along y and then along
+    // x, which turns the array into a Fenwick tree in linear time.
+    for (unsigned x = 1; x <= grid->s; x++) {
+        for (unsigned y = 1; y <= grid->s; y++) {
+            unsigned p = y + (y & -y);
+            if (p > grid->s)
+                continue;
+            for (int k = 0; k < 4; k++)
+                (*index_node(grid, x, p))[k] += (*index_node(grid, x, y))[k];
+        }
+    }
+    for (unsigned x = 1; x <= grid->s; x++) {
+        unsigned p = x + (x & -x);
+        if (p > grid->s)
+            continue;
+        for (unsigned y = 1; y <= grid->s; y++) {
+            for (int k = 0; k < 4; k++)
+                (*index_node(grid, p, y))[k] += (*index_node(grid, x, y))[k];
+        }
+    }
+}
+
+/**
+ * [grid_grow grid w h] makes sure [grid] has room for a [w] × [h] rectangle
+ * of positions anchored at the origin. Returns [true] iff it had to be
+ * resized.
+ */
+static bool
+grid_grow(struct grid *grid, unsigned w, unsigned h)
+{
+    if (w <= grid->s && h <= grid->s)
+        return false;
+
+    unsigned sn = grid->s;
+    while (sn < w || sn < h)
+        sn *= 2;
+    unsigned striden = sn / 64;
+
+    uint64_t *wordsn = calloc((size_t)sn * striden, sizeof(uint64_t));
+    assert(wordsn != NULL);
+
+    for (unsigned y = 0; y < grid->s; y++) {
+        memcpy(wordsn + (size_t)y * striden, grid->words + (size_t)y * grid->stride,
+                grid->stride * sizeof(uint64_t));
+    }
+
+    free(grid->words);
+    grid->words = wordsn;
+    grid->s = sn;
+    grid->stride = striden;
+
+    if (grid->index != NULL)
+        index_build(grid);
+
+    return true;
+}
+
+struct grid *
+grid_alloc()
+{
+    struct grid *grid = malloc(sizeof(struct grid));
+    assert(grid != NULL);
+
+    grid->s = GRID_MIN_SIDE;
+    grid->stride = GRID_MIN_SIDE / 64;
+
+    grid->words = calloc((size_t)grid->s * grid->stride, sizeof(uint64_t));
+    assert(grid->words != NULL);
+
+    grid->index = NULL;
+
+    return grid;
+}
+
+void
+grid_index(struct grid *grid)
+{
+    index_build(grid);
+}
+
+bool
+grid_marked(struct grid *grid, unsigned x, unsigned y)
+{
+    if (x >= grid->s || y >= grid->s)
+        return false;
+
+    return grid->words[(size_t)y * grid->stride + x / 64] >> (x % 64) & 1;
+}
+
+bool
+grid_mark(struct grid *grid, unsigned x, unsigned y)
+{
+    bool resized = grid_grow(grid, x + 1, y + 1);
+
+    if (grid->index != NULL && !grid_marked(grid, x, y))
+        index_fill(grid, x, y, 1, 1);
+
+    grid->words[(size_t)y * grid->stride + x / 64] |= (uint64_t)1 << (x % 64);
+
+    return resized;
+}
+
+bool
+grid_vacant(struct grid *grid, unsigned x, unsigned y, unsigned w, unsigned h)
+{
+    // Everything outside of the allocated storage is unmarked.
+    if (w == 0 || h == 0 || x >= grid->s || y >= grid->s)
+        return true;
+
+    unsigned x1 = x + w < grid->s ? x + w : grid->s;
+    unsigned y1 = y + h < grid->s ? y + h : grid->s;
+
+    if (grid->index != NULL) {
+        return index_prefix(grid, x1, y1) - index_prefix(grid, x, y1)
+            - index_prefix(grid, x1, y) + index_prefix(grid, x, y) == 0;
+    }
+
+    unsigned wlo = x / 64;
+    unsigned whi = (x1 - 1) / 64;
+
+    for (unsigned yy = y; yy < y1; yy++) {
+        const uint64_t *row = grid->words + (size_t)yy * grid->stride;
+
+        if (wlo == whi) {
+            if (row[wlo] & span_mask(x % 64, (x1 - 1) % 64))
+                return false;
+            continue;
+        }
+
+        if (row[wlo] & span_mask(x % 64, 63))
+            return false;
+        for (unsigned i = wlo + 1; i < whi; i++) {
+            if (row[i])
+                return false;
+        }
+        if (row[whi] & span_mask(0, (x1 - 1) % 64))
+            return false;
+    }
+
+    return true;
+}
+
+bool
+grid_fill(struct grid *grid, unsigned x, unsigned y, unsigned w, unsigned h)
+{
+    if (w == 0 || h == 0)
+        return false;
+
+    bool resized = grid_grow(grid, x + w, y + h);
+
+    if (grid->index != NULL)
+        index_fill(grid, x, y, w, h);
+
+    unsigned wlo = x / 64;
+    unsigned whi = (x + w - 1) / 64;
+
+    for (unsigned yy = y; yy < y + h; yy++) {
+        uint64_t *row = grid->words + (size_t)yy * grid->stride;
+
+        if (wlo == whi) {
+            row[wlo] |= span_mask(x % 64, (x + w - 1) % 64);
+            continue;
+        }
+
+        row[wlo] |= span_mask(x % 64, 63);
+        for (unsigned i = wlo + 1; i < whi; i++) {
+            row[i] = ~(uint64_t)0;
+        }
+        row[whi] |= span_mask(0, (x + w - 1) % 64);
+    }
+
+    return resized;
+}
+
+void
+grid_free(struct grid *grid)
+{
+    free(grid->words);
+    free(grid->index);
+    free(grid);
+}
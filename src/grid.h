@@ -0,0 +1,71 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A [grid] represents a two-dimensional grid of pixel squares (each of size
+ * [unit] from [spec]) used in determining where an image can be placed.
+ * The coordinates in a grid refer to whole pixel squares.
+ * Grids are created using [grid_alloc].
+ * [grid_mark] marks a position on a grid, while [grid_marked] checks if a
+ * position is marked. [grid_fill] and [grid_vacant] do the same for whole
+ * rectangles of positions, a 64-position word at a time.
+ * The storage for [grid]s is allocated as needed by [grid_mark] and
+ * [grid_fill], and should be freed with [grid_free].
+ *
+ * A grid can optionally keep an occupancy index (see [grid_index]) that
+ * answers [grid_vacant] in logarithmic time instead of scanning the rectangle.
+ */
+struct grid {
+    unsigned s; //!< [s] is the current side length of the grid. Always a power of two, and at least 64.
+    unsigned stride; //!< [stride] is the number of words in each row of [words], i.e. [s / 64].
+    /**
+     * [words] records the marked positions as one contiguous bitset, row by
+     * row. Position (x, y) is bit [x % 64] of [words[y * stride + x / 64]].
+     */
+    uint64_t *words;
+    /**
+     * [index] is null unless [grid_index] was called. Otherwise it is a 2D
+     * Fenwick tree supporting rectangle updates and rectangle sums over the
+     * marked positions, stored as four interleaved counters per node for
+     * nodes (1, 1) through (s, s). See grid.c for details.
+     */
+    uint32_t (*index)[4];
+};
+
+struct grid *grid_alloc();
+
+/**
+ * [grid_index grid] builds an occupancy index for [grid] and keeps it up to
+ * date from then on. The index takes 16 bytes per position, so it trades
+ * memory for faster [grid_vacant] calls on large rectangles.
+ */
+void grid_index(struct grid *grid);
+
+bool grid_marked(struct grid *grid, unsigned x, unsigned y);
+
+/**
+ * [grid_mark grid x y] marks the position (x, y), growing [grid] if needed.
+ * Returns [true] iff [grid] had to be resized.
+ */
+bool grid_mark(struct grid *grid, unsigned x, unsigned y);
+
+/**
+ * [grid_vacant grid x y w h] returns [true] iff no position in the rectangle
+ * [x, x + w) × [y, y + h) is marked.
+ */
+bool grid_vacant(struct grid *grid, unsigned x, unsigned y, unsigned w, unsigned h);
+
+/**
+ * [grid_fill grid x y w h] marks every position in the rectangle
+ * [x, x + w) × [y, y + h), growing [grid] if needed. If [grid] has an
+ * index, the rectangle must be vacant.
+ * Returns [true] iff [grid] had to be resized.
+ */
+bool grid_fill(struct grid *grid, unsigned x, unsigned y, unsigned w, unsigned h);
+
+void grid_free(struct grid *grid);
+
+#endif
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+
+#include "hash.h"
+
+// See https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md for the
+// description of XXH64 this follows.
+
+static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t P3 = 0x165667B19E3779F9ULL;
+static const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t
+rotl(uint64_t v, int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+/**
+ * [read64 p] and [read32 p] read little-endian words at any alignment.
+ */
+static inline uint64_t
+read64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static inline uint32_t
+read32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t
+round64(uint64_t acc, uint64_t lane)
+{
+    acc += lane * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t
+merge64(uint64_t acc, uint64_t v)
+{
+    acc ^= round64(0, v);
+    return acc * P1 + P4;
+}
+
+uint64_t
+hash64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    } else {
+        h = seed + P5;
+    }
+
+    h += len;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t)read32(p) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * P5;
+        h = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+bool
+hash_file(const char *path, uint64_t seed, uint64_t *hash)
+{
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
+        return false;
+
+    bool ok = false;
+    char *data = NULL;
+
+    if (fseek(stream, 0, SEEK_END))
+        goto close;
+    long len = ftell(stream);
+    if (len < 0 || fseek(stream, 0, SEEK_SET))
+        goto close;
+
+    data = malloc(len + 1);
+    assert(data != NULL);
+
+    if (fread(data, 1, len, stream) != (size_t)len)
+        goto close;
+
+    *hash = hash64(data, len, seed);
+    ok = true;
+
+close:
+    free(data);
+    fclose(stream);
+    return ok;
+}
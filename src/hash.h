@@ -0,0 +1,21 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * [hash64 data len seed] returns the 64-bit XXH64 hash of the [len] bytes at
+ * [data]. Hashes with different [seed]s are independent, and a hash can be
+ * passed as the seed of the next call to hash several buffers as one.
+ */
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+/**
+ * [hash_file path seed hash] stores the [hash64] of the contents of the file
+ * at [path] into [hash]. Returns [false] if the file can't be read.
+ */
+bool hash_file(const char *path, uint64_t seed, uint64_t *hash);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include "lz4.h"
+
+/**
+ * [HASH_BITS] is the log2 of the number of entries in the table of recent
+ * positions that the compressor looks up matches in.
+ */
+#define HASH_BITS 16
+
+/**
+ * The block format requires that the last [LAST_LITERALS] bytes are
+ * literals, and that the last match starts at least [MATCH_LIMIT] bytes
+ * before the end. Matches are at least [MIN_MATCH] bytes long and reach back
+ * at most [MAX_OFFSET] bytes.
+ */
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+static inline uint32_t
+read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline unsigned
+hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * [length dst n] appends the continuation bytes for a literal or match
+ * length of which [n] didn't fit in its 4 bits of the token, and returns
+ * the new end of [dst].
+ */
+static unsigned char *
+length(unsigned char *dst, size_t n)
+{
+    for (; n >= 255; n -= 255)
+        *dst++ = 255;
+    *dst++ = n;
+    return dst;
+}
+
+/**
+ * [sequence dst lit nlit offset match] appends a sequence of the [nlit]
+ * literals at [lit] followed by a match of [match] bytes, [offset] bytes
+ * back, and returns the new end of [dst]. A [match] of 0 appends the
+ * literals alone, which only the last sequence may do.
+ */
+static unsigned char *
+sequence(unsigned char *dst, const unsigned char *lit, size_t nlit, size_t offset, size_t match)
+{
+    unsigned char *token = dst++;
+    *token = (nlit < 15 ? nlit : 15) << 4;
+    if (nlit >= 15)
+        dst = length(dst, nlit - 15);
+
+    memcpy(dst, lit, nlit);
+    dst += nlit;
+
+    if (match == 0)
+        return dst;
+
+    *dst++ = offset;
+    *dst++ = offset >> 8;
+
+    match -= MIN_MATCH;
+    *token |= match < 15 ? match : 15;
+    if (match >= 15)
+        dst = length(dst, match - 15);
+
+    return dst;
+}
+
+size_t
+lz4_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+size_t
+lz4_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+    assert(n < (size_t)UINT32_MAX);
+
+    // [table] maps the hash of 4 bytes to one more than the last position
+    // they were seen at, so that 0 means never.
+    uint32_t *table = calloc((size_t)1 << HASH_BITS, sizeof(uint32_t));
+    assert(table != NULL);
+
+    unsigned char *out = dst;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    // Like lz4 itself, look further and further ahead while nothing
+    // matches, so that incompressible data goes by quickly.
+    unsigned misses = 0;
+
+    while (n >= MATCH_LIMIT + 1 && i < n - MATCH_LIMIT) {
+        uint32_t seq = read32(src + i);
+        unsigned h = hash(seq);
+        size_t candidate = table[h];
+        table[h] = i + 1;
+
+        if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != seq) {
+            i += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        size_t m = candidate - 1;
+        while (i > anchor && m > 0 && src[i - 1] == src[m - 1]) {
+            i--;
+            m--;
+        }
+
+        size_t len = MIN_MATCH;
+        while (i + len < n - LAST_LITERALS && src[i + len] == src[m + len])
+            len++;
+
+        out = sequence(out, src + anchor, i - anchor, i - m, len);
+        i += len;
+        anchor = i;
+
+        // Remember a position inside the match too, which finds the next
+        // match sooner in repetitive data.
+        table[hash(read32(src + i - 2))] = i - 2 + 1;
+    }
+
+    out = sequence(out, src + anchor, n - anchor, 0, 0);
+
+    free(table);
+    return out - dst;
+}
@@ -0,0 +1,22 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+
+/**
+ * [lz4_bound n] returns the most bytes [lz4_compress] can produce from [n]
+ * bytes of input.
+ */
+size_t lz4_bound(size_t n);
+
+/**
+ * [lz4_compress src n dst] compresses the [n] bytes at [src] into [dst] as a
+ * single LZ4 block, and returns the compressed size. [dst] must hold at least
+ * [lz4_bound(n)] bytes, and [n] must be less than 4 GiB.
+ * The block format is documented in lz4's lz4_Block_format.md; any LZ4
+ * decompressor that handles raw blocks can decompress the output, given the
+ * decompressed size.
+ */
+size_t lz4_compress(const unsigned char *src, size_t n, unsigned char *dst);
+
+#endif
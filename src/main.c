@@ -1,28 +1,78 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <ctype.h>
 #include <math.h>
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
+#include <inttypes.h>
+
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <FreeImage.h>
 
 #include "queue.h"
-#include "heap.h"
+#include "pool.h"
+#include "pack.h"
+#include "search.h"
+#include "hash.h"
+#include "cache.h"
+#include "trim.h"
+#include "blit.h"
+#include "decode.h"
+#include "encode.h"
+#include "tex.h"
+#include "phash.h"
+#include "emit.h"
+#include "watch.h"
+#include "stats.h"
+#include "trace.h"
 
 #define MAX_SPEC_LINE_LEN 1024
 
+/**
+ * Embedded files are read [EMBED_CHUNK] bytes at a time, and written
+ * [EMBED_PER_LINE] bytes to a line.
+ */
+#define EMBED_CHUNK (1 << 20)
+#define EMBED_PER_LINE 20
+
+/**
+ * With --watch, a change is acted on once no more have arrived for
+ * [WATCH_SETTLE] milliseconds.
+ */
+#define WATCH_SETTLE 20
+
+/**
+ * A [sprite] is a PNG that more than one [input] of a batch of
+ * specifications is loaded from, so that it's hashed and decoded only once.
+ * Each input takes its own copy of the decoded image, and the last of them
+ * to be freed frees the sprite.
+ */
+struct sprite {
+    pthread_mutex_t lock; //!< [lock] protects everything below.
+    bool hashed; //!< [hashed] is set once [hash] is.
+    uint64_t hash; //!< [hash] is the [hash_file] hash of the PNG, or 0 if it can't be read.
+    bool loaded; //!< [loaded] is set once [bitmap] is.
+    FIBITMAP *bitmap; //!< [bitmap] is the decoded 32-bit image, or null if it can't be decoded.
+    unsigned users; //!< [users] is the number of inputs sharing the sprite that haven't been freed.
+};
+
 // Define the type of a queue of inputs.
 // See queue.h and OpenBSD's documentation for details.
 SIMPLEQ_HEAD(inputshd, input);
 
 /**
  * An [input] represents an image we are packing.
- * The [at] field is initially null but eventually contains the [posn] in the
- * packed image at which this image is placed.
+ * The [at] field eventually contains the [posn] in the packed image at which
+ * this image is placed, and [page] which packed image that is.
  */
 struct input {
     /**
@@ -32,21 +82,79 @@ struct input {
      * C identifier name.
      */
     char *name;
+    char *path; //!< [path] is where the image is loaded from, i.e. "<from>/<name>.png".
+    struct sprite *sprite; //!< [sprite] is null unless the file at [path] is shared with other inputs of a batch.
 
-    FIBITMAP *bitmap; //!< [bitmap] is the actual image data.
     /**
-     * [at] is initially null but is set to the [posn] in the packed image at
-     * which this image is placed by the packing procedure.
+     * [bitmap] is the actual image data, as 32-bit pixels, after trimming,
+     * or null for an image that is decoded straight onto its page.
+     */
+    FIBITMAP *bitmap;
+    bool failed; //!< [failed] is set if the image couldn't be decoded onto its page.
+    uint64_t hash; //!< [hash] is the [hash_file] hash of the PNG at [path], or 0 if it can't be read.
+    uint64_t digest; //!< [digest] is a hash of the pixels of [bitmap], set by the dedup directive.
+    /**
+     * [same] is null, or with the dedup directive, the earlier input with
+     * exactly the same pixels as this one. This input is then not packed
+     * itself, and shares the placement of [same].
+     */
+    struct input *same;
+    /**
+     * [at] is set to the [posn] in pixels at which this image is placed by
+     * the packing procedure, within the packed image [page] of its [spec].
      */
-    struct posn *at;
+    struct posn at;
+    unsigned page;
+
+    unsigned w; //!< [w] is the width of the image in pixels, after trimming.
+    unsigned h; //!< [h] is the height of the image in pixels, after trimming.
 
-    unsigned w; //!< [w] is the width of the image in pixels.
-    unsigned h; //!< [h] is the height of the image in pixels.
+    /**
+     * [off] is the position in pixels of the trimmed image within the
+     * original one, and [ow] and [oh] are the original's size. Without the
+     * trim directive, [off] is (0, 0) and [ow] and [oh] equal [w] and [h].
+     */
+    struct posn off;
+    unsigned ow;
+    unsigned oh;
 
     // A pointer to the next item in the input queue. See queue.h for details.
     SIMPLEQ_ENTRY(input) entries;
 };
 
+/**
+ * A [page] is one of the packed images. Without the maxsize directive there
+ * is only one.
+ */
+struct page {
+    char *path; //!< [path] is where the page is written.
+    char *texture; //!< [texture] is where the page's texture container is written, if the texture directive is given.
+    unsigned w; //!< [w] is the width of the page in pixels.
+    unsigned h; //!< [h] is the height of the page in pixels.
+    FIBITMAP *bitmap; //!< [bitmap] holds the page's pixels while they're being composited.
+    bool failed; //!< [failed] is set if the page couldn't be saved.
+    bool dirty; //!< [dirty] is set if [bitmap] changed since the page was last saved.
+};
+
+/**
+ * A [specstats] structure collects what --stats reports about running a
+ * [spec]. See the README.
+ */
+struct specstats {
+    const char *result; //!< [result] says what running the specification did, or is null if it didn't run.
+    struct stagetime stages[STAGES]; //!< [stages] holds the time spent in each [stage].
+    struct packstats pack; //!< [pack] adds up the [packstats] of every packing tried.
+    unsigned inputs; //!< [inputs] is the number of images in the specification.
+    /**
+     * [packed] is the number of inputs that were packed, after deduplication,
+     * [area] the number of pixels on all the pages, and [used] the number
+     * covered by packed images. They're 0 unless the inputs were packed.
+     */
+    unsigned packed;
+    double area;
+    double used;
+};
+
 /**
  * A [spec] structure contains the parsed data from the .pngsquare file given
  * as the argument to pngsquare. See the README for information about
@@ -60,39 +168,176 @@ struct spec {
     char *hi; //!< [hi] is the include path that the generated C code should use to load the C header.
     char *from; //!< [from] is the path to the directory where the images to pack are stored.
     int unit; //!< [unit] is the side length of the pixel square to use in the heuristic. See README for details.
+    enum engine engine; //!< [engine] is the packing engine chosen by the optional packer directive.
+    enum rule rule; //!< [rule] is the engine's placement rule, if it has more than one.
+    bool trim; //!< [trim] is set by the trim directive, to pack only the visible part of each image.
+    bool dedup; //!< [dedup] is set by the dedup directive, to pack images with identical pixels once.
+    unsigned maxw; //!< [maxw] is the maximum width of a page set by the maxsize directive, or 0 if unlimited.
+    unsigned maxh; //!< [maxh] is the maximum height of a page set by the maxsize directive, or 0 if unlimited.
+    /**
+     * [encode] is set by the encode directive (or the -e option), to write
+     * the pages with [encode_png] and [encodeopts] rather than FreeImage.
+     */
+    bool encode;
+    struct encodeopts encodeopts;
+    /**
+     * [texture] is set by the texture directive, to also write each page as
+     * a texture container compressed with [compression], which the
+     * generated code loads instead of the PNG. See tex.h.
+     */
+    bool texture;
+    unsigned compression;
+    /**
+     * [malloced] is set by 'rects malloc', to generate code that allocates
+     * each rectangle at load time, as pngsquare used to, rather than point
+     * into a constant table of them.
+     */
+    bool malloced;
+    /**
+     * [find] is set by the find directive, to generate a function that looks
+     * an image's rectangle up by name through a [phash].
+     */
+    bool find;
+    /**
+     * [embed] is set by the embed directive, to write the bytes of every
+     * page (of its texture container, with the texture directive) into the
+     * generated source, so loading doesn't touch the file system.
+     */
+    bool embed;
 
     struct inputshd inputs; //!< The queue of [input]s to process.
+
+    struct page *pages; //!< [pages] holds the [npages] packed images, once the inputs are placed.
+    unsigned npages;
+
+    char *cachepath; //!< [cachepath] is where the [cache] of the outputs is written, next to [png].
+    uint64_t key; //!< [key] is the [spec_key] of the outputs.
+
+    struct specstats stats;
 };
 
 /**
- * A [posn] represents a coordinate (x, y).
- * We use it to represent the pixel square with coordinates (x, y), which means
- * that to get the position of the pixel square in pixels you need to multiply
- * by [spec->unit].
+ * An [options] structure holds the command line options that apply to every
+ * specification. See the README.
  */
-struct posn {
-    unsigned x;
-    unsigned y;
+struct options {
+    unsigned jobs; //!< [jobs] is the number of threads used for the parallel stages.
+    /**
+     * [indexed] is set if the grid should keep an occupancy index rather than
+     * scanning candidate rectangles. See grid.h.
+     */
+    bool indexed;
+    bool verbose; //!< [verbose] is set if statistics about the packing should be printed.
+    /**
+     * [searching] is set if many packings should be tried, keeping the
+     * smallest according to [searchopts]. See search.h.
+     */
+    bool searching;
+    struct searchopts searchopts;
+    bool rebuild; //!< [rebuild] is set if the cache should be ignored.
+    /**
+     * [encoding] is set if [encodeopts] should override the specification's
+     * encode directive. See encode.h.
+     */
+    bool encoding;
+    struct encodeopts encodeopts;
+    /**
+     * [watch] is set if the outputs should be kept up to date as the inputs
+     * and the specification file change, until pngsquare is killed.
+     */
+    bool watch;
+    bool stats; //!< [stats] is set if statistics should be printed as JSON once every specification has run.
+    const char *trace; //!< [trace] is the path the trace is written to, or null if nothing is traced.
 };
 
 /**
- * A [grid] represents a two-dimensional grid of pixel squares (each of size
- * [unit] from [spec]) used in determining where an image can be placed.
- * The coordinates in a grid refer to whole pixel squares.
- * Grids are created using [grid_alloc].
- * [grid_mark] marks a position on a grid, while [grid_marked] checks if a
- * position is marked.
- * The storage for [grid]s is allocated as needed by [grid_mark], and should be
- * freed with [grid_free].
+ * A [batch] is the context for [batch_run]: the [n] parsed [specs], the
+ * [paths] they were parsed from, and the [opts] and [pool] shared by all of
+ * them. Whether each specification ran successfully is kept in [ok], and
+ * with --stats its [report] in [reports].
  */
-struct grid {
-    unsigned s; //!< [s] is the current side length of the grid. Should be a power of two.
-    bool **posns; //!< [posns] records the marked positions.
+struct batch {
+    struct spec **specs;
+    char **paths;
+    unsigned n;
+    const struct options *opts;
+    struct pool *pool;
+    bool *ok;
+    char **reports;
 };
 
 struct input *input_alloc();
 void input_free(struct input *input);
 
+/**
+ * [input_load ctx i] loads the image data for the [i]th [input] of the array
+ * [ctx], unless it's already loaded, and sets its dimensions. It is intended for use with [pool_for], so it
+ * doesn't report errors; on failure [input->bitmap] is left null.
+ */
+void input_load(void *ctx, unsigned i);
+
+/**
+ * [input_probe ctx i] sets the dimensions of the [i]th [input] of the array
+ * [ctx] from the header of its PNG, unless it's already loaded, leaving its
+ * [bitmap] null so that [input_blit] decodes it straight onto its page. An
+ * input with a [sprite] is loaded instead, so the sprite is decoded once. It
+ * is intended for use with [pool_for]; on failure the dimensions are left 0.
+ */
+void input_probe(void *ctx, unsigned i);
+
+/**
+ * [input_trim ctx i] crops the loaded image of the [i]th [input] of the array
+ * [ctx] to its visible pixels, updating [off] and its dimensions accordingly.
+ * A fully transparent image is cropped to its top-left pixel. It is intended
+ * for use with [pool_for].
+ */
+void input_trim(void *ctx, unsigned i);
+
+/**
+ * [input_digest ctx i] sets the [digest] of the [i]th [input] of the array
+ * [ctx], which must be loaded. It is intended for use with [pool_for].
+ */
+void input_digest(void *ctx, unsigned i);
+
+/**
+ * [input_same a b] returns [true] iff the loaded [input]s [a] and [b] have
+ * exactly the same dimensions and pixels.
+ */
+bool input_same(const struct input *a, const struct input *b);
+
+/**
+ * [dedup inputsarr n] points the [same] field of every one of the [n]
+ * [input]s in [inputsarr] with the same pixels as an earlier one at the
+ * earliest such input. Their [digest]s must have been set. The inputs are
+ * then reordered so that the ones with no [same] come first, keeping their
+ * relative order, and their number is returned.
+ */
+unsigned dedup(struct input **inputsarr, unsigned n);
+
+/**
+ * [input_hash ctx i] sets the [hash] of the [i]th [input] of the array [ctx].
+ * It is intended for use with [pool_for].
+ */
+void input_hash(void *ctx, unsigned i);
+
+/**
+ * [load_png path] returns the PNG at [path] decoded to 32-bit pixels, or null
+ * if it can't be.
+ */
+FIBITMAP *load_png(const char *path);
+
+/**
+ * [share_sprites pool specs n] gives every input of the [n] [specs] that is
+ * loaded from the same file as another input a [sprite] shared with it.
+ */
+void share_sprites(struct pool *pool, struct spec **specs, unsigned n);
+
+/**
+ * [sprite_release sprite] is called as each input sharing [sprite] is freed,
+ * and frees it after the last one.
+ */
+void sprite_release(struct sprite *sprite);
+
 /**
  * [input_cmp a b] returns 1 if the max side length of the [input] [a] is
  * greater than the max side length of [b], -1 if it is less, and 0 if they are
@@ -100,19 +345,154 @@ void input_free(struct input *input);
  */
 int input_cmp(const void *a, const void *b);
 
+struct spec *spec_alloc();
+void spec_free(struct spec *spec);
+
 /**
- * [posn_cmp] returns [true] if the coordinates of the [posn] [a] is
- * less than the coordinates for [b] and false otherwise.
- * First the maximums of the x and y values are compared; if equality occurs,
- * then the individual components are compared.
- * It is intended for use with [heap].
+ * [spec_pages spec npages] replaces the [pages] of [spec] with [npages] empty
+ * ones, named after [spec->png]: unchanged without the maxsize directive, and
+ * otherwise with the page's index inserted before the ".png" extension.
  */
-bool posn_cmp(const void *a, const void *b);
+void spec_pages(struct spec *spec, unsigned npages);
 
-struct spec *spec_alloc();
-void spec_free(struct spec *spec);
+/**
+ * [read_manifest path paths n] appends the specification file paths listed
+ * in the manifest at [path], one per line, to the array [paths] of [n] paths,
+ * growing it as needed. Blank lines and lines starting with '#' are skipped.
+ * Returns [false] (after printing an error) if the manifest can't be read.
+ */
+bool read_manifest(const char *path, char ***paths, unsigned *n);
+
+/**
+ * [spec_inputs spec n] returns a newly allocated array of pointers to the
+ * [input]s of [spec], in specification order, and stores their number into
+ * [n].
+ */
+struct input **spec_inputs(const struct spec *spec, unsigned *n);
+
+/**
+ * [run spec path opts pool] brings the outputs of the specification [spec],
+ * parsed from [path], up to date: with [update] if the cache allows it, and
+ * otherwise with [build]. Returns [false] (after printing an error) on
+ * failure.
+ */
+bool run(struct spec *spec, const char *path, const struct options *opts, struct pool *pool);
+
+/**
+ * [batch_run ctx i] runs the [i]th specification of the [batch] [ctx], and
+ * then frees it. It is intended for use with [pool_for], so specifications
+ * run side by side, each running its own stages across the same pool.
+ */
+void batch_run(void *ctx, unsigned i);
+
+/**
+ * [report spec path] returns the --stats JSON object describing the run of
+ * [spec], parsed from [path], as a string to be freed by the caller.
+ */
+char *report(const struct spec *spec, const char *path);
+
+/**
+ * [stage_stop spec stage timer] adds the time since [timer] was started to
+ * the time [spec] spent in [stage], and traces it as a span.
+ */
+void stage_stop(struct spec *spec, enum stage stage, const struct timer *timer);
+
+/**
+ * [build spec opts pool inputsarr inputslen] loads, places and composites the
+ * [inputslen] hashed inputs of [spec] in [inputsarr], which it reorders, and
+ * writes all of the outputs and the cache. Returns [false] (after printing an
+ * error) on failure.
+ */
+bool build(struct spec *spec, const struct options *opts, struct pool *pool, struct input **inputsarr,
+        unsigned inputslen);
+
+/**
+ * [refresh spec opts pool inputs n full] brings the outputs of the built
+ * (and watched) [spec] up to date after some of its [n] [inputs] may have
+ * changed. Only those whose hash changed are loaded again, and if they kept
+ * their dimensions they are copied over their old places in the pages that
+ * are still in memory, and only those pages saved. Otherwise, or if [full]
+ * is set, every input is placed again with [build]. Returns [false] (after
+ * printing an error) on failure.
+ */
+bool refresh(struct spec *spec, const struct options *opts, struct pool *pool, struct input **inputs,
+        unsigned n, bool full);
+
+/**
+ * [watch spec path opts pool] runs [spec], parsed from [path], and then keeps
+ * its outputs up to date as its inputs or the file at [path] change, using
+ * [refresh] or parsing [path] and running it again. It only returns if
+ * watching fails, with the specification last parsed, or null.
+ */
+struct spec *watch(struct spec *spec, const char *path, const struct options *opts, struct pool *pool);
+
+/**
+ * [place spec pool packopts searchopts inputs n verbose] packs the [n]
+ * [inputs] into a single image and sets their [at]. If [searchopts] isn't
+ * null, many packings are tried with [search] and the smallest kept;
+ * otherwise [inputs] is sorted and packed with [packopts], adding to the
+ * [pack] statistics of [spec]. The time taken is added to them either way.
+ */
+void place(struct spec *spec, struct pool *pool, const struct packopts *packopts,
+        const struct searchopts *searchopts, struct input **inputs, unsigned n, bool verbose);
+
+/**
+ * [page_fit spec inputs n] reorders the [n] placed [inputs] so that those
+ * that lie within the maxsize of [spec] come first, keeping their relative
+ * order, and returns their number. If none do, the first input is moved to
+ * the origin so that it does.
+ */
+unsigned page_fit(const struct spec *spec, struct input **inputs, unsigned n);
+
+/**
+ * A [pagework] is the context for the page stages below: the pages of
+ * [spec] and the [n] [inputs] to composite onto them, and the [pool] to
+ * encode them on. If [keep] is set, pages keep their bitmaps once saved.
+ */
+struct pagework {
+    struct pool *pool;
+    struct spec *spec;
+    struct input **inputs;
+    unsigned n;
+    bool keep;
+};
+
+/**
+ * [page_load ctx p] loads the existing [p]th page of the [pagework] [ctx]
+ * into its [bitmap], if any of the inputs belong on it and it has the
+ * expected size. Otherwise [bitmap] is left null.
+ */
+void page_load(void *ctx, unsigned p);
+
+/**
+ * [page_alloc ctx p] sets the [bitmap] of the [p]th page of the [pagework]
+ * [ctx] to a blank 32-bit image of the page's size.
+ */
+void page_alloc(void *ctx, unsigned p);
+
+/**
+ * [input_blit ctx i] copies the [i]th input of the [pagework] [ctx] into the
+ * [bitmap] of its page at [at], unless it shares another input's placement.
+ * An input without a [bitmap] is decoded from its PNG straight into place,
+ * setting [failed] if that fails.
+ * Placed inputs never overlap, so inputs can be copied in parallel.
+ */
+void input_blit(void *ctx, unsigned i);
+
+/**
+ * [page_save ctx p] saves the [bitmap] of the [p]th page of the [pagework]
+ * [ctx], if it has one that is [dirty], setting [failed] if that fails, and
+ * then frees it unless the work says to [keep] it.
+ * All of these are intended for use with [pool_for].
+ */
+void page_save(void *ctx, unsigned p);
 
-void parse_spec(struct spec *spec, const char *path);
+/**
+ * [parse_spec spec path] parses the specification file at [path] into
+ * [spec]. Returns [false] (after printing an error) if it can't be read or
+ * isn't valid.
+ */
+bool parse_spec(struct spec *spec, const char *path);
 
 /**
  * [parse_directive dst key stream] checks to makes ure the next directive in
@@ -122,315 +502,1118 @@ void parse_spec(struct spec *spec, const char *path);
  */
 char *parse_directive(char *dst, const char *key, FILE *stream);
 
-struct grid *grid_alloc();
-bool grid_marked(struct grid *grid, unsigned x, unsigned y);
-bool grid_mark(struct grid *grid, unsigned x, unsigned y);
-void grid_free(struct grid *grid);
+/**
+ * [parse_option spec line] parses [line] if it is one of the optional
+ * directives that may follow the unit directive, storing its value into
+ * [spec]. Returns 1 if it was parsed, 0 if [line] isn't an optional directive,
+ * and -1 (after printing an error) if it is one but its value is invalid.
+ */
+int parse_option(struct spec *spec, const char *line);
 
 /**
- * [isvalidname c] returns [true] iff [c] is a valid C identifier name.
+ * [spec_key path searching searchopts encodeopts] returns the [cache] key for
+ * the specification file at [path] packed with the given options, where
+ * [encodeopts] is null unless -e was given. Every option that affects the
+ * outputs must be part of the key.
  */
-bool isvalidname(const char *c);
+uint64_t spec_key(const char *path, bool searching, const struct searchopts *searchopts,
+        const struct encodeopts *encodeopts);
 
-int
-main(int argc, char *argv[])
-{
-    struct spec *spec = NULL;
-    struct input *input = NULL;
+/**
+ * [update spec pool inputsarr n cache key path verbose] brings the outputs of [spec]
+ * up to date using [cache] rather than packing from scratch, if it can.
+ * [inputsarr] holds the [n] inputs in specification order, already hashed.
+ * Only inputs whose hash changed are loaded, and if they all kept their
+ * dimensions they are pasted over their old places in the existing packed
+ * images, and the cache is rewritten to [path]. Returns 1 if the outputs are up to date, 0 if they must be rebuilt
+ * and -1 (after printing an error) on failure.
+ */
+int update(struct spec *spec, struct pool *pool, struct input **inputsarr, unsigned n,
+        const struct cache *cache, uint64_t key, const char *path, bool verbose);
 
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <spec>\n", argv[0]);
-        return 1;
-    }
+/**
+ * [reshares spec changed before n] returns [true] iff, with the dedup
+ * directive, any of the [n] [changed] inputs of [spec], whose old copies are
+ * in [before] and whose [digest]s have been set again, shared its placement
+ * with another input, or has the same pixels as another input now.
+ */
+bool reshares(const struct spec *spec, struct input **changed, const struct input *before, unsigned n);
 
-    spec = spec_alloc();
-    assert(spec != NULL);
+/**
+ * [shares cache inputsarr] returns [true] iff any of the inputs of
+ * [inputsarr] that changed since [cache] shares its placement in [cache] with
+ * another, or now has the same hash as another.
+ */
+bool shares(const struct cache *cache, struct input **inputsarr);
 
-    parse_spec(spec, argv[1]);
+/**
+ * [store spec key path] writes a [cache] describing the placed inputs and
+ * the pages of [spec] to [path].
+ */
+bool store(const struct spec *spec, uint64_t key, const char *path);
 
-    FreeImage_Initialise(false);
+/**
+ * [write_header spec] and [write_source spec] write the generated C header
+ * and source for the placed inputs of [spec]. They return [false] (after
+ * printing an error) on failure.
+ */
+bool write_header(const struct spec *spec);
+bool write_source(const struct spec *spec);
 
-    // Load the image data for each [input].
+/**
+ * [write_loader cfh spec] writes the functions that the generated source of
+ * [spec] uses to load its texture containers to [cfh]: from memory, and
+ * unless they're embedded, from their files.
+ */
+void write_loader(FILE *cfh, const struct spec *spec);
 
-    int inputslen = 0;
-    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        char *path = malloc(strlen(input->name) + strlen(spec->from) + 6); // appending {/, .png, \0}
-        assert(path != NULL);
+/**
+ * [write_tables cfh spec] writes the constant table of rectangles of [spec]
+ * and the [PACK] structure that its generated [_load] function copies to
+ * [cfh].
+ */
+void write_tables(FILE *cfh, const struct spec *spec);
 
-        sprintf(path, "%s/%s.png", spec->from, input->name);
+/**
+ * [write_data cfh spec] writes the bytes of the files of the pages of [spec]
+ * that its generated code loads to [cfh], as arrays. Returns [false] (after
+ * printing an error) if a file can't be read.
+ */
+bool write_data(FILE *cfh, const struct spec *spec);
 
-        input->bitmap = FreeImage_Load(FIF_PNG, path, 0);
-        free(path);
-        if (input->bitmap == NULL) {
-            fprintf(stderr, "failed to load image at %s\n", path);
-            goto close;
-        }
+/**
+ * [write_bytes cfh array path] writes the contents of the file at [path] to
+ * [cfh] as the definition of the constant array [array]. Returns [false]
+ * (after printing an error) if the file can't be read.
+ */
+bool write_bytes(FILE *cfh, const char *array, const char *path);
 
-        input->w = FreeImage_GetWidth(input->bitmap);
-        input->h = FreeImage_GetHeight(input->bitmap);
+/**
+ * [write_find cfh spec] writes the [_find] function of [spec] and the tables
+ * of its [phash] to [cfh]. Returns [false] (after printing an error) if the
+ * hash can't be built.
+ */
+bool write_find(FILE *cfh, const struct spec *spec);
 
-        inputslen++;
-    }
+/**
+ * [isvalidname c] returns [true] iff [c] is a valid C identifier name.
+ */
+bool isvalidname(const char *c);
 
-    // [inputsarr] will store pointers to [input]s sorted in order of
-    // decreasing maximum side length.
-    struct input **inputsarr = malloc(inputslen * sizeof(struct input *));
-    assert(inputsarr != NULL);
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-vBw] [-j jobs] [-i scan|fenwick] [-s area|pot [-t ms]] [-e level[,strategy]] "
+            "[-m manifest] [--stats=json] [--trace file] <spec>...\n", argv0);
+}
 
-    int i = 0;
-    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        inputsarr[i] = input;
-        i++;
+int
+main(int argc, char *argv[])
+{
+    // [timer] times the whole process, for --stats.
+    struct timer timer;
+    timer_start(&timer);
+
+    // Reading the umask means setting it, which isn't safe once threads
+    // are writing files.
+    emit_init();
+
+    struct pool *pool = NULL;
+
+    // [paths] holds the paths of the specification files to run, from the
+    // arguments and from manifests, in order.
+    char **paths = NULL;
+    unsigned npaths = 0;
+
+    struct options opts;
+    opts.jobs = ncpus();
+    opts.indexed = false;
+    opts.verbose = false;
+    opts.searching = false;
+    opts.searchopts.metric = METRIC_AREA;
+    opts.searchopts.budget = 0;
+    opts.rebuild = false;
+    opts.encoding = false;
+    opts.watch = false;
+    opts.stats = false;
+    opts.trace = NULL;
+
+    static const struct option longopts[] = {
+        { "verbose", no_argument, NULL, 'v' },
+        { "jobs", required_argument, NULL, 'j' },
+        { "index", required_argument, NULL, 'i' },
+        { "search", required_argument, NULL, 's' },
+        { "budget", required_argument, NULL, 't' },
+        { "rebuild", no_argument, NULL, 'B' },
+        { "encode", required_argument, NULL, 'e' },
+        { "watch", no_argument, NULL, 'w' },
+        { "manifest", required_argument, NULL, 'm' },
+        { "stats", required_argument, NULL, 'S' },
+        { "trace", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "vBwj:i:s:t:e:m:", longopts, NULL)) != -1) {
+        switch (opt) {
+        case 'v':
+            opts.verbose = true;
+            break;
+        case 'B':
+            opts.rebuild = true;
+            break;
+        case 'w':
+            opts.watch = true;
+            break;
+        case 'j':
+            if (atoi(optarg) < 1) {
+                fprintf(stderr, "-j must specify a positive integer\n");
+                return 1;
+            }
+            opts.jobs = atoi(optarg);
+            break;
+        case 'i':
+            if (!strcmp(optarg, "fenwick")) {
+                opts.indexed = true;
+            } else if (!strcmp(optarg, "scan")) {
+                opts.indexed = false;
+            } else {
+                fprintf(stderr, "-i must be one of scan, fenwick\n");
+                return 1;
+            }
+            break;
+        case 's':
+            opts.searching = true;
+            if (!strcmp(optarg, "area")) {
+                opts.searchopts.metric = METRIC_AREA;
+            } else if (!strcmp(optarg, "pot")) {
+                opts.searchopts.metric = METRIC_POT;
+            } else {
+                fprintf(stderr, "-s must be one of area, pot\n");
+                return 1;
+            }
+            break;
+        case 't':
+            if (atoi(optarg) < 1) {
+                fprintf(stderr, "-t must specify a positive number of milliseconds\n");
+                return 1;
+            }
+            opts.searchopts.budget = atoi(optarg);
+            break;
+        case 'e':
+            if (!encode_parse(&opts.encodeopts, optarg)) {
+                fprintf(stderr, "-e must be one of fast, default, max or 0-9, optionally followed by a comma and "
+                        "one of default, filtered, rle, huffman\n");
+                return 1;
+            }
+            opts.encoding = true;
+            break;
+        case 'm':
+            if (!read_manifest(optarg, &paths, &npaths))
+                return 1;
+            break;
+        case 'S':
+            if (strcmp(optarg, "json")) {
+                fprintf(stderr, "--stats must be json\n");
+                return 1;
+            }
+            opts.stats = true;
+            break;
+        case 'T':
+            opts.trace = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
     }
 
-    qsort(inputsarr, inputslen, sizeof(struct input *), input_cmp);
+    for (int i = optind; i < argc; i++) {
+        paths = realloc(paths, (npaths + 1) * sizeof(char *));
+        assert(paths != NULL);
+        paths[npaths] = strdup(argv[i]);
+        assert(paths[npaths] != NULL);
+        npaths++;
+    }
 
-    // [grid] will record which positions in the packed image already contain
-    // an image (or a part of one). The minimum position unit is a square of
-    // pixels of side length [spec->unit].
-    struct grid *grid = grid_alloc();
-    assert(grid != NULL);
+    if (npaths == 0) {
+        usage(argv[0]);
+        return 1;
+    }
 
-    // [frontier] is a min-heap w.r.t. position coordinates which we will use
-    // to get the position we should next try to place an input image at.
-    struct heap *frontier = heap_init(posn_cmp);
+    if (opts.watch && npaths > 1) {
+        fprintf(stderr, "-w only watches a single specification file\n");
+        return 1;
+    }
 
-    // [start] is the top-left corner, where we will try to place the first image.
-    struct posn *start = malloc(sizeof(struct posn));
-    assert(start != NULL);
+    if (opts.watch && (opts.stats || opts.trace != NULL)) {
+        fprintf(stderr, "--stats and --trace can't be used with -w, which never finishes\n");
+        return 1;
+    }
 
-    start->x = 0;
-    start->y = 0;
+    if (opts.trace != NULL && !trace_open(opts.trace))
+        return 1;
 
-    assert(!heap_push(frontier, start));
+    // Every specification is parsed before anything is packed, so a typo in
+    // one of a batch doesn't leave the others half built.
+    struct spec **specs = malloc(npaths * sizeof(struct spec *));
+    assert(specs != NULL);
 
-    // Pack all of the input images.
-    // For an overview of the heuristic, see the README.
-    for (int i = 0; i < inputslen; i++) {
-        struct input *input = inputsarr[i];
-        // Get the width and height in terms of [spec->unit].
-        int wu = ceil((double)input->w / spec->unit);
-        int hu = ceil((double)input->h / spec->unit);
-
-        // [posnqhd] will point to a queue of positions we have tried to insert
-        // the current image at but which didn't work, due to not enough space
-        // being available. At the end of the attempting-to-place loop, we add
-        // these back to the heap.
-        SIMPLEQ_HEAD(posnqhd, posnq) posnqhd = SIMPLEQ_HEAD_INITIALIZER(posnqhd);
-        struct posnq {
-            struct posn *v;
-            SIMPLEQ_ENTRY(posnq) entries;
-        };
-
-        // Loop while we try to find somewhere to put this input.
-        for (;;) {
-            if (frontier->len == 0) {
-                // This should not be possible (means we've somehow ran out of
-                // places to try placing images at.
-                assert(false);
-            }
+    bool parsed = true;
+    for (unsigned i = 0; i < npaths; i++) {
+        specs[i] = spec_alloc();
+        assert(specs[i] != NULL);
 
-            // [top] is the position we will try to place this input image at.
-            struct posn *top = heap_pop(frontier);
-            assert(top != NULL);
+        struct timer parsing;
+        timer_start(&parsing);
+        bool ok = parse_spec(specs[i], paths[i]);
+        stage_stop(specs[i], STAGE_PARSE, &parsing);
 
-            // If the position has been filled by someone, there's no use
-            // keeping it in the heap.
-            if (grid_marked(grid, top->x, top->y)) {
-                free(top);
-                continue;
+        if (!ok) {
+            if (npaths > 1) {
+                fprintf(stderr, "failed to parse specification file %s\n", paths[i]);
             }
+            parsed = false;
+        }
+    }
 
-            // Check to make sure there is enough space available at this
-            // position to place the image.
-            bool failed = false;
-            for (int y = top->y; !failed && y < top->y + hu; y++) {
-                for (int x = top->x; x < top->x + wu; x++) {
-                    if (grid_marked(grid, x, y)) {
-                        failed = true;
-                        break;
-                    }
-                }
-            }
-            // If we failed, add this position to the queue of positions to add
-            // back to the heap after we're done.  We don't want to add it back
-            // immediately, obviously, because then we'd end up in an infinite
-            // loop...
-            if (failed) {
-                struct posnq *posnq = malloc(sizeof(struct posnq *));
-                assert(posnq != NULL);
-                posnq->v = top;
-                SIMPLEQ_INSERT_TAIL(&posnqhd, posnq, entries);
-                continue;
+    // [failed] is set if any specification couldn't be brought up to date,
+    // so that build systems driving pngsquare see it in the exit status.
+    bool failed = false;
+
+    if (parsed) {
+        FreeImage_Initialise(false);
+
+        pool = pool_alloc(opts.jobs);
+        assert(pool != NULL);
+
+        if (opts.watch) {
+            // Watching only stops when it fails.
+            specs[0] = watch(specs[0], paths[0], &opts, pool);
+            failed = true;
+        } else {
+            // Inputs loaded from the same file are decoded once for the whole
+            // batch. The specifications themselves all run at once, so that
+            // the stages of one fill in the gaps between those of others.
+            if (npaths > 1) {
+                share_sprites(pool, specs, npaths);
             }
 
-            // We haven't failed--mark the positions now occupied by the input
-            // image!
-            for (int y = top->y; y < top->y + hu; y++) {
-                for (int x = top->x; x < top->x + wu; x++) {
-                    grid_mark(grid, x, y);
-                }
+            char **reports = NULL;
+            if (opts.stats) {
+                reports = calloc(npaths, sizeof(char *));
+                assert(reports != NULL);
             }
 
-            input->at = top;
+            bool *ok = calloc(npaths, sizeof(bool));
+            assert(ok != NULL);
 
-            // [a] and [b] are the new positions for subsequent images to try.
-            // One is at the north-east corner of this image, and the other is
-            // at the southwest corner.
-            struct posn *a = malloc(sizeof(struct posn));
-            assert(a != NULL);
+            struct batch batch = { specs, paths, npaths, &opts, pool, ok, reports };
+            pool_for(pool, npaths, batch_run, &batch);
 
-            struct posn *b = malloc(sizeof(struct posn));
-            assert(b != NULL);
-
-            a->x = top->x + wu;
-            a->y = top->y;
-
-            b->x = top->x;
-            b->y = top->y + hu;
+            for (unsigned i = 0; i < npaths; i++) {
+                if (!ok[i])
+                    failed = true;
+            }
+            free(ok);
 
-            assert(!heap_push(frontier, a));
-            assert(!heap_push(frontier, b));
+            if (opts.stats) {
+                struct stagetime total = { 0, 0 };
+                timer_stop(&timer, &total);
 
-            break;
+                printf("{\"jobs\": %u, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"peak_rss_kb\": %ld, \"specs\": [",
+                        opts.jobs, 1000 * total.wall, 1000 * total.cpu, peak_rss());
+                for (unsigned i = 0; i < npaths; i++) {
+                    printf("%s\n  %s", i > 0 ? "," : "", reports[i]);
+                    free(reports[i]);
+                }
+                printf("\n]}\n");
+                free(reports);
+            }
         }
 
-        // Add the positions that didn't have space for the image back to the
-        // queue, because they might work for a smaller image.
-        struct posnq *posnq, *tposnq;
-        SIMPLEQ_FOREACH_SAFE(posnq, &posnqhd, entries, tposnq) {
-            assert(!heap_push(frontier, posnq->v));
-            free(posnq);
-        }
+        pool_free(pool);
     }
 
-    // Free the remaining positions.
-    for (int i = 0; i < frontier->len; i++) {
-        free(frontier->data[i]);
+    // The pool's threads are done, so every span is in.
+    bool traced = trace_close();
+
+    for (unsigned i = 0; i < npaths; i++) {
+        if (specs[i] != NULL) {
+            spec_free(specs[i]);
+        }
+        free(paths[i]);
     }
+    free(specs);
+    free(paths);
 
-    // [wf] and [hf] will contain width and height of the packed image.
-    int wf = 0;
-    int hf = 0;
-    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        int wp = input->at->x * spec->unit + input->w;
-        int hp = input->at->y * spec->unit + input->h;
+    if (!parsed)
+        return 1;
 
-        if (wp > wf)
-            wf = wp;
+    FreeImage_DeInitialise();
+    return failed || !traced ? 1 : 0;
+}
 
-        if (hp > hf)
-            hf = hp;
+bool
+read_manifest(const char *path, char ***paths, unsigned *n)
+{
+    FILE *stream = fopen(path, "r");
+    if (stream == NULL) {
+        fprintf(stderr, "read_manifest: failed to open %s: %s\n", path, strerror(errno));
+        return false;
     }
 
-    heap_free(frontier);
-    grid_free(grid);
-
-    FIBITMAP *output = FreeImage_Allocate(wf, hf, 32, 0, 0, 0);
-    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        struct posn *at = input->at;
-        assert(FreeImage_Paste(output, input->bitmap, at->x * spec->unit, at->y * spec->unit, 256));
-    }
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, stream)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0 || line[0] == '#')
+            continue;
 
-    if (!FreeImage_Save(FIF_PNG, output, spec->png, 0)) {
-        fprintf(stderr, "FreeImage_Save: failed to save output image to %s\n", spec->png); 
-        goto close;
+        *paths = realloc(*paths, (*n + 1) * sizeof(char *));
+        assert(*paths != NULL);
+        (*paths)[*n] = strdup(line);
+        assert((*paths)[*n] != NULL);
+        (*n)++;
     }
 
-    FILE *hfh = fopen(spec->h, "w");
-    if (hfh == NULL) {
-        fprintf(stderr, "fopen: failed to open file at %s for writing: %s\n", spec->h, strerror(errno));
-        goto close;
+    bool ok = !ferror(stream);
+    if (!ok) {
+        fprintf(stderr, "read_manifest: failed to read %s\n", path);
     }
 
-    // XXX This is a little messy. :(
+    free(line);
+    fclose(stream);
+    return ok;
+}
 
-    fprintf(hfh, "#ifndef %s_h\n", spec->name);
-    fprintf(hfh, "#define %s_h\n\n", spec->name);
+void
+batch_run(void *ctx, unsigned i)
+{
+    struct batch *batch = ctx;
 
-    fprintf(hfh, "#include <SDL2/SDL.h>\n\n");
+    batch->ok[i] = run(batch->specs[i], batch->paths[i], batch->opts, batch->pool);
 
-    fprintf(hfh, "struct %s {\n", spec->name);
-    fprintf(hfh, "    SDL_Texture *t;\n\n");
-    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        fprintf(hfh, "    SDL_Rect *%s;\n", input->name);
+    if (batch->opts->stats) {
+        batch->reports[i] = report(batch->specs[i], batch->paths[i]);
     }
-    fprintf(hfh, "};\n\n");
-    
-    fprintf(hfh, "struct %s *%s_load(SDL_Renderer *renderer);\n", spec->name, spec->name);
-    fprintf(hfh, "void %s_unload (struct %s *pack);\n\n", spec->name, spec->name);
 
-    fprintf(hfh, "#endif\n");
+    // Freeing each specification as soon as it's done lets go of its
+    // inputs, and of any sprites only it still shared.
+    spec_free(batch->specs[i]);
+    batch->specs[i] = NULL;
+}
+
+char *
+report(const struct spec *spec, const char *path)
+{
+    const struct specstats *stats = &spec->stats;
+
+    char *buf;
+    size_t len;
+    FILE *out = open_memstream(&buf, &len);
+    assert(out != NULL);
+
+    fprintf(out, "{\"name\": ");
+    json_string(out, spec->name);
+    fprintf(out, ", \"path\": ");
+    json_string(out, path);
+    fprintf(out, ", \"result\": ");
+    json_string(out, stats->result != NULL ? stats->result : "failed");
+    fprintf(out, ", \"inputs\": %u, \"packed\": %u, \"pages\": %u, \"occupancy\": ",
+            stats->inputs, stats->packed, spec->npages);
+    if (stats->area > 0)
+        fprintf(out, "%.4f", stats->used / stats->area);
+    else
+        fprintf(out, "null");
 
-    if (fclose(hfh)) {
-        fprintf(stderr, "fclose: %s\n", strerror(errno));
+    fprintf(out, ", \"stages\": {");
+    for (int s = 0; s < STAGES; s++) {
+        fprintf(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", s > 0 ? ", " : "", stage_name(s),
+                1000 * stats->stages[s].wall, 1000 * stats->stages[s].cpu);
     }
 
-    FILE *cfh = fopen(spec->c, "w");
-    if (cfh == NULL) {
-        fprintf(stderr, "fopen: failed to open file at %s for writing: %s\n", spec->c, strerror(errno));
+    fprintf(out, "}, \"pack\": {\"frontier_peak\": %zu, \"pops\": %lu, \"rejected\": %lu, "
+            "\"grid_resizes\": %lu, \"objects\": %lu, \"allocs\": %lu}}",
+            stats->pack.peak, stats->pack.pops, stats->pack.rejected, stats->pack.resizes, stats->pack.objects,
+            stats->pack.allocs);
+
+    fclose(out);
+    return buf;
+}
+
+void
+stage_stop(struct spec *spec, enum stage stage, const struct timer *timer)
+{
+    timer_stop(timer, &spec->stats.stages[stage]);
+    trace_end(&timer->wall, "stage", stage_name(stage), spec->name, NULL);
+}
+
+bool
+run(struct spec *spec, const char *path, const struct options *opts, struct pool *pool)
+{
+    if (opts->encoding) {
+        spec->encode = true;
+        spec->encodeopts = opts->encodeopts;
+    }
+
+    // [inputsarr] will store pointers to [input]s, first in specification
+    // order and then, once they're loaded, sorted in order of decreasing
+    // maximum side length.
+    unsigned inputslen;
+    struct input **inputsarr = spec_inputs(spec, &inputslen);
+    spec->stats.inputs = inputslen;
+
+    // The cache lives next to the packed image. Hashing the inputs is much
+    // cheaper than decoding them, so it's done up front to find out which
+    // ones (if any) need to be decoded at all.
+    spec->cachepath = malloc(strlen(spec->png) + 7); // appending {.cache, \0}
+    assert(spec->cachepath != NULL);
+    sprintf(spec->cachepath, "%s.cache", spec->png);
+
+    spec->key = spec_key(path, opts->searching, &opts->searchopts, opts->encoding ? &opts->encodeopts : NULL);
+
+    struct timer timer;
+    timer_start(&timer);
+    pool_for(pool, inputslen, input_hash, inputsarr);
+    stage_stop(spec, STAGE_HASH, &timer);
+
+    // Watching starts from a full build, since it keeps what that loads.
+    struct cache cache;
+    if (!opts->rebuild && !opts->watch && cache_read(&cache, spec->cachepath)) {
+        int updated = update(spec, pool, inputsarr, inputslen, &cache, spec->key, spec->cachepath,
+                opts->verbose);
+        cache_free(&cache);
+
+        if (updated) {
+            if (updated < 0) {
+                spec->stats.result = "failed";
+            }
+            free(inputsarr);
+            return updated > 0;
+        }
+    }
+
+    bool built = build(spec, opts, pool, inputsarr, inputslen);
+    if (!built) {
+        spec->stats.result = "failed";
+    }
+    free(inputsarr);
+    return built;
+}
+
+bool
+build(struct spec *spec, const struct options *opts, struct pool *pool, struct input **inputsarr,
+        unsigned inputslen)
+{
+    struct input *input;
+
+    // From here on the outputs are rewritten, so the cache can't be trusted
+    // until they all have been.
+    if (unlink(spec->cachepath) && errno != ENOENT) {
+        fprintf(stderr, "unlink: failed to remove %s: %s\n", spec->cachepath, strerror(errno));
+    }
+
+    // Trimming and deduplication look at the pixels of the inputs before
+    // placing them. Otherwise placement only needs their sizes, which their
+    // headers give, and each input is decoded straight onto its page once
+    // that exists, rather than into a bitmap of its own and then copied.
+    // Watching keeps every input decoded, to repack without decoding the
+    // unchanged ones again.
+    bool direct = !spec->trim && !spec->dedup && !opts->watch;
+
+    struct specstats *stats = &spec->stats;
+    struct timer timer;
+
+    // Load the image data (or just the sizes) for each [input] in parallel.
+    // Decoding finishes in whatever order it likes, so failures are reported
+    // afterwards in specification order.
+    timer_start(&timer);
+    pool_for(pool, inputslen, direct ? input_probe : input_load, inputsarr);
+    stage_stop(spec, STAGE_DECODE, &timer);
+
+    bool loaded = true;
+    for (unsigned i = 0; i < inputslen; i++) {
+        if (direct ? inputsarr[i]->w == 0 : inputsarr[i]->bitmap == NULL) {
+            fprintf(stderr, "failed to load image at %s\n", inputsarr[i]->path);
+            loaded = false;
+        }
+    }
+    if (!loaded)
+        return false;
+
+    if (spec->trim) {
+        timer_start(&timer);
+        pool_for(pool, inputslen, input_trim, inputsarr);
+        stage_stop(spec, STAGE_TRIM, &timer);
+    }
+
+    // [packlen] is the number of inputs at the front of [inputsarr] that
+    // actually need to be packed; the others share their placements.
+    unsigned packlen = inputslen;
+    if (spec->dedup) {
+        // A previous build of a watched specification has already
+        // deduplicated the inputs, and [dedup] starts from scratch.
+        for (unsigned i = 0; i < inputslen; i++) {
+            inputsarr[i]->same = NULL;
+        }
+        timer_start(&timer);
+        pool_for(pool, inputslen, input_digest, inputsarr);
+        packlen = dedup(inputsarr, inputslen);
+        stage_stop(spec, STAGE_DEDUP, &timer);
+    }
+
+    // With the maxsize directive, every input must fit on a page by itself.
+    if (spec->maxw > 0) {
+        bool fits = true;
+        for (unsigned i = 0; i < packlen; i++) {
+            if (inputsarr[i]->w > spec->maxw || inputsarr[i]->h > spec->maxh) {
+                fprintf(stderr, "image at %s is %ux%u, larger than the maximum page size %ux%u\n",
+                        inputsarr[i]->path, inputsarr[i]->w, inputsarr[i]->h, spec->maxw, spec->maxh);
+                fits = false;
+            }
+        }
+        if (!fits)
+            return false;
+    }
+
+    struct packopts packopts = { spec->engine, spec->rule, opts->indexed };
+
+    // -v reports on this packing alone, though watching builds again and
+    // again.
+    memset(&stats->pack, 0, sizeof(struct packstats));
+
+    // Fill one page at a time: pack everything that's left, keep what landed
+    // within the maximum page size, and pack the rest again onto the next
+    // page. Without maxsize everything lands on the first page.
+    unsigned npages = 0;
+    struct input **rest = inputsarr;
+    unsigned nrest = packlen;
+    do {
+        place(spec, pool, &packopts, opts->searching ? &opts->searchopts : NULL, rest, nrest, opts->verbose);
+
+        unsigned fit = spec->maxw > 0 ? page_fit(spec, rest, nrest) : nrest;
+        for (unsigned k = 0; k < fit; k++) {
+            rest[k]->page = npages;
+        }
+
+        npages++;
+        rest += fit;
+        nrest -= fit;
+    } while (nrest > 0);
+
+    for (unsigned i = packlen; i < inputslen; i++) {
+        inputsarr[i]->at = inputsarr[i]->same->at;
+        inputsarr[i]->page = inputsarr[i]->same->page;
+    }
+
+    // Each page is just big enough for the inputs on it.
+    spec_pages(spec, npages);
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        struct page *page = &spec->pages[input->page];
+
+        if (input->at.x + input->w > page->w)
+            page->w = input->at.x + input->w;
+
+        if (input->at.y + input->h > page->h)
+            page->h = input->at.y + input->h;
+    }
+
+    // [used] is the number of pixels actually covered by input images on each
+    // page, and [kept] the number that would be without deduplication.
+    double *used = calloc(npages, sizeof(double));
+    assert(used != NULL);
+    double kept = 0;
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        if (input->same == NULL)
+            used[input->page] += (double)input->w * input->h;
+        kept += (double)input->w * input->h;
+    }
+
+    double total = 0;
+    stats->packed = packlen;
+    stats->area = 0;
+    for (unsigned p = 0; p < npages; p++) {
+        total += used[p];
+        stats->area += (double)spec->pages[p].w * spec->pages[p].h;
+    }
+    stats->used = total;
+
+    if (opts->verbose) {
+        if (spec->maxw == 0) {
+            double area = (double)spec->pages[0].w * spec->pages[0].h;
+            fprintf(stderr, "%s: packed %u images into %ux%u (%.0f pixels), %.1f%% occupied\n",
+                    spec->name, inputslen, spec->pages[0].w, spec->pages[0].h, area,
+                    area > 0 ? 100 * used[0] / area : 0);
+        } else {
+            fprintf(stderr, "%s: packed %u images onto %u page%s of at most %ux%u\n",
+                    spec->name, inputslen, npages, npages == 1 ? "" : "s", spec->maxw, spec->maxh);
+            for (unsigned p = 0; p < npages; p++) {
+                double area = (double)spec->pages[p].w * spec->pages[p].h;
+                fprintf(stderr, "%s: page %u is %ux%u (%.0f pixels), %.1f%% occupied\n",
+                        spec->name, p, spec->pages[p].w, spec->pages[p].h, area, area > 0 ? 100 * used[p] / area : 0);
+            }
+        }
+
+        if (spec->trim) {
+            // [original] is the number of pixels before trimming.
+            double original = 0;
+            SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+                original += (double)input->ow * input->oh;
+            }
+
+            fprintf(stderr, "%s: trimming removed %.0f of %.0f pixels (%.1f%%)\n",
+                    spec->name, original - kept, original, original > 0 ? 100 * (original - kept) / original : 0);
+        }
+
+        if (spec->dedup) {
+            // Each pixel left out of the packed image is 4 bytes saved, both
+            // decoded in memory and in the texture.
+            fprintf(stderr, "%s: %u duplicate images share placements, saving %.0f bytes\n",
+                    spec->name, inputslen - packlen, 4 * (kept - total));
+        }
+
+        if (stats->pack.objects > 0) {
+            fprintf(stderr, "%s: frontier used %lu positions and retry nodes from %lu allocation%s\n",
+                    spec->name, stats->pack.objects, stats->pack.allocs, stats->pack.allocs == 1 ? "" : "s");
+        }
+    }
+    free(used);
+
+    // Placement is decided, so the inputs can be copied onto the pages in
+    // parallel, and then the pages encoded in parallel. Failures are reported
+    // afterwards in page order. Watching keeps the pages too, so changed
+    // inputs can be copied over them later.
+    struct pagework work = { pool, spec, inputsarr, inputslen, opts->watch };
+    timer_start(&timer); // decoding straight onto the pages counts as compositing them
+    pool_for(pool, npages, page_alloc, &work);
+    pool_for(pool, inputslen, input_blit, &work);
+    stage_stop(spec, STAGE_COMPOSITE, &timer);
+
+    for (unsigned i = 0; i < inputslen; i++) {
+        if (inputsarr[i]->failed) {
+            fprintf(stderr, "failed to load image at %s\n", inputsarr[i]->path);
+            loaded = false;
+        }
+    }
+    if (!loaded)
+        return false;
+
+    timer_start(&timer);
+    pool_for(pool, npages, page_save, &work);
+    stage_stop(spec, STAGE_ENCODE, &timer);
+
+    bool saved = true;
+    for (unsigned p = 0; p < npages; p++) {
+        if (spec->pages[p].failed) {
+            fprintf(stderr, "failed to save output image to %s\n", spec->pages[p].path);
+            saved = false;
+        }
+    }
+    if (!saved)
+        return false;
+
+    timer_start(&timer);
+    bool written = write_header(spec) && write_source(spec);
+    stage_stop(spec, STAGE_EMIT, &timer);
+    if (!written)
+        return false;
+
+    timer_start(&timer);
+    store(spec, spec->key, spec->cachepath);
+    stage_stop(spec, STAGE_CACHE, &timer);
+    stats->result = "built";
+    return true;
+
+}
+
+bool
+refresh(struct spec *spec, const struct options *opts, struct pool *pool, struct input **inputs,
+        unsigned n, bool full)
+{
+    // [before] holds copies of the inputs as they were, to tell which ones
+    // changed and whether they still fit their places.
+    struct input *before = malloc(n * sizeof(struct input) + 1);
+    assert(before != NULL);
+
+    for (unsigned i = 0; i < n; i++) {
+        before[i] = *inputs[i];
+    }
+
+    pool_for(pool, n, input_hash, inputs);
+
+    // [changed] holds the inputs whose contents differ from before, and the
+    // front of [before] their copies.
+    struct input **changed = malloc(n * sizeof(struct input *) + 1);
+    assert(changed != NULL);
+
+    unsigned nchanged = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (inputs[i]->hash == 0 || inputs[i]->hash != before[i].hash) {
+            before[nchanged] = before[i];
+            changed[nchanged++] = inputs[i];
+        }
+    }
+
+    bool ok = true;
+    if (nchanged == 0 && !full)
         goto close;
+
+    for (unsigned k = 0; k < nchanged; k++) {
+        if (changed[k]->bitmap != NULL) {
+            FreeImage_Unload(changed[k]->bitmap);
+            changed[k]->bitmap = NULL;
+        }
     }
 
-    fprintf(cfh, "#include <assert.h>\n\n");
-    fprintf(cfh, "#include <SDL2/SDL.h>\n#include <SDL2/SDL_image.h>\n\n");
+    pool_for(pool, nchanged, input_load, changed);
 
-    fprintf(cfh, "#include \"%s\"\n\n", spec->hi);
+    for (unsigned k = 0; k < nchanged; k++) {
+        if (changed[k]->bitmap == NULL) {
+            fprintf(stderr, "failed to load image at %s\n", changed[k]->path);
+            changed[k]->hash = 0;
+            ok = false;
+        }
+    }
+    if (!ok)
+        goto close;
 
-    fprintf(cfh, "static const char *PNG_PATH = \"%s\";\n\n", spec->png);
+    if (spec->trim) {
+        pool_for(pool, nchanged, input_trim, changed);
+    }
 
-    fprintf(cfh, "struct %s *\n", spec->name);
-    fprintf(cfh, "%s_load(SDL_Renderer *renderer)\n", spec->name);
-    fprintf(cfh, "{\n");
-    fprintf(cfh, "    struct %s *pack = malloc(sizeof(struct %s));\n", spec->name, spec->name);
-    fprintf(cfh, "    assert(pack != NULL);\n\n");
+    // As with the cache, an input only fits its old place if it kept its
+    // dimensions, and with trimming kept its visible part in the same place.
+    bool inplace = !full;
+    for (unsigned k = 0; k < nchanged && inplace; k++) {
+        const struct input *input = changed[k];
+        const struct input *was = &before[k];
+        inplace = input->w == was->w && input->h == was->h && input->off.x == was->off.x
+                && input->off.y == was->off.y && input->ow == was->ow && input->oh == was->oh;
+    }
 
-    fprintf(cfh, "    SDL_Surface* raw = IMG_Load(PNG_PATH);\n");
-    fprintf(cfh, "    if (raw == NULL) {\n");
-    fprintf(cfh, "        fprintf(stderr, \"%s: failed to load image %%s: %%s\\n\", PNG_PATH, IMG_GetError());\n", spec->name);
-    fprintf(cfh, "        exit(1);\n");
-    fprintf(cfh, "    }\n\n");
+    if (inplace && spec->dedup) {
+        pool_for(pool, nchanged, input_digest, changed);
+        inplace = !reshares(spec, changed, before, nchanged);
+    }
 
-    fprintf(cfh, "    pack->t = SDL_CreateTextureFromSurface(renderer, raw);\n");
-    fprintf(cfh, "    if (pack->t == NULL) {\n");
-    fprintf(cfh, "        fprintf(stderr, \"%s: failed to create texture of image %%s: %%s\\n\", PNG_PATH, SDL_GetError());\n", spec->name);
-    fprintf(cfh, "        exit(1);\n");
-    fprintf(cfh, "    }\n\n");
+    if (!inplace) {
+        unsigned inputslen;
+        struct input **inputsarr = spec_inputs(spec, &inputslen);
+        ok = build(spec, opts, pool, inputsarr, inputslen);
+        free(inputsarr);
+        goto close;
+    }
+
+    if (unlink(spec->cachepath) && errno != ENOENT) {
+        fprintf(stderr, "unlink: failed to remove %s: %s\n", spec->cachepath, strerror(errno));
+    }
+
+    // The pages are still in memory, so only those the changed inputs are
+    // copied onto need saving.
+    for (unsigned k = 0; k < nchanged; k++) {
+        spec->pages[changed[k]->page].dirty = true;
+    }
+
+    struct pagework work = { pool, spec, changed, nchanged, true };
+    pool_for(pool, nchanged, input_blit, &work);
+    pool_for(pool, spec->npages, page_save, &work);
+
+    for (unsigned p = 0; p < spec->npages; p++) {
+        if (spec->pages[p].failed) {
+            fprintf(stderr, "failed to save output image to %s\n", spec->pages[p].path);
+            ok = false;
+        }
+    }
+    if (ok && spec->embed) {
+        ok = write_source(spec);
+    }
+    if (!ok)
+        goto close;
+
+    store(spec, spec->key, spec->cachepath);
+
+    if (opts->verbose) {
+        fprintf(stderr, "%s: updated %u image%s in place\n", spec->name, nchanged, nchanged == 1 ? "" : "s");
+    }
+
+close:
+    free(before);
+    free(changed);
+    return ok;
+}
+
+/**
+ * [digest_cmp a b] orders [digest]s, for [qsort].
+ */
+static int
+digest_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
 
-    fprintf(cfh, "    SDL_FreeSurface(raw);\n\n");
+bool
+reshares(const struct spec *spec, struct input **changed, const struct input *before, unsigned n)
+{
+    struct input *input;
 
+    // [digests] holds the digest of every input, sorted, so that equal ones
+    // are next to each other.
+    unsigned len = 0;
     SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        fprintf(cfh, "    pack->%s = malloc(sizeof(SDL_Rect));\n", input->name);
-        fprintf(cfh, "    assert(pack->%s != NULL);\n", input->name);
-        fprintf(cfh, "    pack->%s->x = %d;\n", input->name, input->at->x * spec->unit);
-        fprintf(cfh, "    pack->%s->y = %d;\n", input->name, input->at->y * spec->unit);
-        fprintf(cfh, "    pack->%s->w = %d;\n", input->name, input->w);
-        fprintf(cfh, "    pack->%s->h = %d;\n\n", input->name, input->h);
+        len++;
     }
 
-    fprintf(cfh, "    return pack;\n");
-    fprintf(cfh, "}\n\n");
+    uint64_t *digests = malloc(len * sizeof(uint64_t) + 1);
+    assert(digests != NULL);
 
-    fprintf(cfh, "void\n");
-    fprintf(cfh, "%s_unload (struct %s *pack)\n", spec->name, spec->name);
-    fprintf(cfh, "{\n");
-    
+    unsigned i = 0;
     SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
-        fprintf(cfh, "    free(pack->%s);\n", input->name);
+        digests[i++] = input->digest;
+    }
+    qsort(digests, len, sizeof(uint64_t), digest_cmp);
+
+    // An input that shared its placement shared its old digest with another
+    // one, which still has it; an input that now has the same pixels as
+    // another shares its new digest. Equal digests almost always mean equal
+    // pixels, and a false match just costs a repack.
+    bool shared = false;
+    for (unsigned k = 0; k < n && !shared; k++) {
+        unsigned copies = 0;
+        for (unsigned round = 0; round < 2; round++) {
+            uint64_t digest = round == 0 ? changed[k]->digest : before[k].digest;
+            if (round == 1 && digest == changed[k]->digest)
+                break;
+
+            unsigned lo = 0;
+            unsigned hi = len;
+            while (lo < hi) {
+                unsigned mid = lo + (hi - lo) / 2;
+                if (digests[mid] < digest)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            while (lo < len && digests[lo] == digest) {
+                copies++;
+                lo++;
+            }
+        }
+        shared = changed[k]->same != NULL || copies != 1;
     }
 
-    fprintf(cfh, "    free(pack);\n");
-    fprintf(cfh, "}\n");
+    free(digests);
+    return shared;
+}
+
+/**
+ * A [watching] is the context for [watch_change]: the ids of the watched
+ * directories of the specification file [specname] and of the inputs, the
+ * [n] inputs of the specification sorted by name in [byname], which of them
+ * were [touched] and the [ntouched] touched inputs themselves, in
+ * [changed], whether the specification file changed, and whether changes
+ * were [lost] because the watcher dropped events.
+ */
+struct watching {
+    int specid;
+    const char *specname;
+    int fromid;
+    struct input **byname;
+    unsigned n;
+    bool *touched;
+    struct input **changed;
+    unsigned ntouched;
+    bool respec;
+    bool lost;
+};
+
+/**
+ * [input_namecmp a b] orders [input]s by [name], for [qsort].
+ */
+static int
+input_namecmp(const void *a, const void *b)
+{
+    const struct input *i = *(const struct input **)a;
+    const struct input *j = *(const struct input **)b;
+
+    return strcmp(i->name, j->name);
+}
+
+/**
+ * [watch_inputs w watcher spec] points [w] at the inputs of [spec], which
+ * may be null, watching the directory they're in instead of the last one.
+ */
+static void
+watch_inputs(struct watching *w, struct watcher *watcher, const struct spec *spec)
+{
+    free(w->byname);
+    free(w->touched);
+    free(w->changed);
+    w->byname = NULL;
+    w->touched = NULL;
+    w->changed = NULL;
+    w->n = 0;
+    w->ntouched = 0;
+    w->respec = false;
+    w->lost = false;
+
+    // The inputs may be next to the specification file, in which case both
+    // share a watch, which must stay.
+    int id = spec != NULL ? watcher_add(watcher, spec->from) : -1;
+    if (w->fromid >= 0 && w->fromid != id && w->fromid != w->specid) {
+        watcher_remove(watcher, w->fromid);
+    }
+    w->fromid = id;
 
+    if (spec == NULL)
+        return;
+
+    w->byname = spec_inputs(spec, &w->n);
+    qsort(w->byname, w->n, sizeof(struct input *), input_namecmp);
+
+    w->touched = calloc(w->n + 1, sizeof(bool));
+    assert(w->touched != NULL);
+
+    w->changed = malloc(w->n * sizeof(struct input *) + 1);
+    assert(w->changed != NULL);
+}
 
-    if (fclose(cfh)) {
-        fprintf(stderr, "fclose: %s\n", strerror(errno));
+/**
+ * [watch_change ctx id name] is the [watcher_fn_t] of [watch], for the
+ * [watching] [ctx]. Only the specification file and the PNGs of its inputs
+ * matter, so that writing the outputs doesn't set off another refresh.
+ */
+static bool
+watch_change(void *ctx, int id, const char *name)
+{
+    struct watching *w = ctx;
+
+    // Dropped events could have been about anything, so every input counts
+    // as touched.
+    if (id < 0) {
+        for (unsigned i = 0; i < w->n; i++) {
+            if (!w->touched[i]) {
+                w->touched[i] = true;
+                w->changed[w->ntouched++] = w->byname[i];
+            }
+        }
+        w->lost = true;
+        return true;
     }
-close:
-    spec_free(spec);
-    FreeImage_DeInitialise();
+
+    if (id == w->specid && !strcmp(name, w->specname)) {
+        w->respec = true;
+        return true;
+    }
+    if (id != w->fromid)
+        return false;
+
+    size_t len = strlen(name);
+    if (len < 4 || strcmp(name + len - 4, ".png"))
+        return false;
+    len -= 4;
+
+    unsigned lo = 0;
+    unsigned hi = w->n;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        const char *other = w->byname[mid]->name;
+
+        // [name] still has its extension, so compare up to it.
+        int cmp = strncmp(name, other, len);
+        if (cmp == 0 && other[len] != '\0')
+            cmp = -1;
+
+        if (cmp == 0) {
+            if (!w->touched[mid]) {
+                w->touched[mid] = true;
+                w->changed[w->ntouched++] = w->byname[mid];
+            }
+            return true;
+        }
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return false;
 }
 
+struct spec *
+watch(struct spec *spec, const char *path, const struct options *opts, struct pool *pool)
+{
+    struct watcher *watcher = watcher_alloc();
+    if (watcher == NULL)
+        return spec;
+
+    // [dirname] and [basename] may modify their argument, so each gets a
+    // copy of [path].
+    char *dir = strdup(path);
+    assert(dir != NULL);
+    char *base = strdup(path);
+    assert(base != NULL);
+
+    // The specification file is watched through its directory, since
+    // editors often replace a file rather than write to it.
+    struct watching w = { -1, basename(base), -1, NULL, 0, NULL, NULL, 0, false, false };
+    w.specid = watcher_add(watcher, dirname(dir));
+    if (w.specid < 0)
+        goto close;
+
+    // Watching starts before the first run, so that changes made while it
+    // runs are acted on once it's done.
+    watch_inputs(&w, watcher, spec);
+    bool current = run(spec, path, opts, pool);
+
+    while (watcher_wait(watcher, watch_change, &w, WATCH_SETTLE)) {
+        if (w.lost) {
+            // The specification file may have changed unnoticed too, which
+            // its hash in the key tells.
+            fprintf(stderr, "watch: events were dropped, so every input is checked again\n");
+            if (spec == NULL || spec_key(path, opts->searching, &opts->searchopts,
+                        opts->encoding ? &opts->encodeopts : NULL) != spec->key)
+                w.respec = true;
+        }
+
+        if (w.respec) {
+            if (spec != NULL) {
+                spec_free(spec);
+            }
+            spec = spec_alloc();
+            assert(spec != NULL);
+
+            if (parse_spec(spec, path)) {
+                current = run(spec, path, opts, pool);
+            } else {
+                spec_free(spec);
+                spec = NULL;
+            }
+
+            watch_inputs(&w, watcher, spec);
+            continue;
+        }
+
+        current = refresh(spec, opts, pool, w.changed, w.ntouched, !current || w.lost);
+
+        memset(w.touched, 0, w.n * sizeof(bool));
+        w.ntouched = 0;
+        w.lost = false;
+    }
+
+close:
+    free(w.byname);
+    free(w.touched);
+    free(w.changed);
+    free(dir);
+    free(base);
+    watcher_free(watcher);
+    return spec;
+}
 struct spec *
 spec_alloc()
 {
@@ -444,7 +1627,24 @@ spec_alloc()
     spec->hi = NULL;
     spec->from = NULL;
     spec->unit = 0;
+    spec->engine = ENGINE_FRONTIER;
+    spec->rule = RULE_BOTTOM_LEFT;
+    spec->trim = false;
+    spec->dedup = false;
+    spec->maxw = 0;
+    spec->maxh = 0;
+    spec->encode = false;
+    spec->texture = false;
+    spec->compression = TEX_RAW;
+    spec->malloced = false;
+    spec->find = false;
+    spec->embed = false;
     SIMPLEQ_INIT(&spec->inputs);
+    spec->pages = NULL;
+    spec->npages = 0;
+    spec->cachepath = NULL;
+    spec->key = 0;
+    memset(&spec->stats, 0, sizeof(struct specstats));
 
     return spec;
 }
@@ -465,281 +1665,1889 @@ spec_free(struct spec *spec)
         input_free(input);
     }
 
+    spec_pages(spec, 0);
+    free(spec->cachepath);
+
     free(spec);
 }
 
-struct input *
-input_alloc()
+void
+spec_pages(struct spec *spec, unsigned npages)
 {
-    struct input *input = malloc(sizeof(struct input));
-    if (input == NULL) return NULL;
+    for (unsigned p = 0; p < spec->npages; p++) {
+        free(spec->pages[p].path);
+        free(spec->pages[p].texture);
+        if (spec->pages[p].bitmap != NULL) {
+            FreeImage_Unload(spec->pages[p].bitmap);
+        }
+    }
+    free(spec->pages);
 
-    input->name = NULL;
-    input->bitmap = NULL;
-    input->at = NULL;
-    input->w = 0;
-    input->h = 0;
+    spec->pages = NULL;
+    spec->npages = npages;
+    if (npages == 0)
+        return;
+
+    spec->pages = malloc(npages * sizeof(struct page));
+    assert(spec->pages != NULL);
+
+    size_t len = strlen(spec->png);
+    // [stem] is the length of [spec->png] without its extension.
+    size_t stem = len >= 4 && !strcmp(spec->png + len - 4, ".png") ? len - 4 : len;
+
+    for (unsigned p = 0; p < npages; p++) {
+        struct page *page = &spec->pages[p];
+
+        page->path = malloc(len + 12); // inserting {_, up to 10 digits, \0}
+        assert(page->path != NULL);
+        if (spec->maxw == 0)
+            strcpy(page->path, spec->png);
+        else
+            sprintf(page->path, "%.*s_%u%s", (int)stem, spec->png, p, spec->png + stem);
+
+        page->texture = NULL;
+        if (spec->texture) {
+            page->texture = malloc(stem + 16); // appending {_, up to 10 digits, .tex, \0}
+            assert(page->texture != NULL);
+            if (spec->maxw == 0)
+                sprintf(page->texture, "%.*s.tex", (int)stem, spec->png);
+            else
+                sprintf(page->texture, "%.*s_%u.tex", (int)stem, spec->png, p);
+        }
+
+        page->w = 0;
+        page->h = 0;
+        page->bitmap = NULL;
+        page->failed = false;
+        page->dirty = false;
+    }
+}
+
+struct input **
+spec_inputs(const struct spec *spec, unsigned *n)
+{
+    struct input *input;
+
+    *n = 0;
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        (*n)++;
+    }
+
+    struct input **inputs = malloc(*n * sizeof(struct input *) + 1);
+    assert(inputs != NULL);
+
+    unsigned i = 0;
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        inputs[i++] = input;
+    }
+
+    return inputs;
+}
+
+void
+place(struct spec *spec, struct pool *pool, const struct packopts *packopts,
+        const struct searchopts *searchopts, struct input **inputs, unsigned n, bool verbose)
+{
+    struct packstats *stats = &spec->stats.pack;
+    struct timer timer;
+    struct box *boxes = malloc(n * sizeof(struct box) + 1);
+    assert(boxes != NULL);
+
+    struct posn *at = malloc(n * sizeof(struct posn) + 1);
+    assert(at != NULL);
+
+    // [unit] is the unit the placements come back in.
+    unsigned unit = spec->unit;
+
+    if (searchopts != NULL) {
+        // Let [search] try its candidates, which sort the inputs themselves,
+        // on the sizes in pixels. The winner may use a finer unit than the
+        // specification's.
+        for (unsigned i = 0; i < n; i++) {
+            boxes[i].w = inputs[i]->w;
+            boxes[i].h = inputs[i]->h;
+        }
+
+        // Each candidate sorts its own copy of the boxes, so all of the
+        // search counts as packing.
+        struct searchresult result;
+        timer_start(&timer);
+        search(pool, searchopts, boxes, n, packopts, spec->unit, at, &result);
+        stage_stop(spec, STAGE_PACK, &timer);
+
+        unit = result.unit;
+
+        if (verbose) {
+            fprintf(stderr, "%s: tried %u of %u candidates, best was order %s, packer %s%s%s, unit %u\n",
+                    spec->name, result.tried, result.candidates, order_name(result.order),
+                    engine_name(result.opts.engine), result.opts.engine == ENGINE_FRONTIER ? "" : " ",
+                    result.opts.engine == ENGINE_FRONTIER ? "" : rule_name(result.opts.rule), result.unit);
+        }
+    } else {
+        timer_start(&timer);
+        qsort(inputs, n, sizeof(struct input *), input_cmp);
+        stage_stop(spec, STAGE_SORT, &timer);
+
+        // Pack all of the input images, in terms of [spec->unit].
+        for (unsigned i = 0; i < n; i++) {
+            boxes[i].w = ceil((double)inputs[i]->w / spec->unit);
+            boxes[i].h = ceil((double)inputs[i]->h / spec->unit);
+        }
+
+        unsigned long pops = stats->pops;
+        unsigned long rejected = stats->rejected;
+
+        timer_start(&timer);
+        pack(packopts, boxes, n, at, stats);
+        stage_stop(spec, STAGE_PACK, &timer);
+
+        // The counts only exist once packing is done, so they get a span of
+        // their own covering the same time.
+        trace_end(&timer.wall, "stage", "place", spec->name, "\"boxes\": %u, \"attempts\": %lu, \"rejected\": %lu",
+                n, stats->pops - pops, stats->rejected - rejected);
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        inputs[i]->at.x = at[i].x * unit;
+        inputs[i]->at.y = at[i].y * unit;
+    }
+
+    free(boxes);
+    free(at);
+}
+
+unsigned
+page_fit(const struct spec *spec, struct input **inputs, unsigned n)
+{
+    struct input **rest = malloc(n * sizeof(struct input *) + 1);
+    assert(rest != NULL);
+
+    unsigned fit = 0;
+    unsigned nrest = 0;
+    for (unsigned i = 0; i < n; i++) {
+        struct input *input = inputs[i];
+        if (input->at.x + input->w <= spec->maxw && input->at.y + input->h <= spec->maxh)
+            inputs[fit++] = input;
+        else
+            rest[nrest++] = input;
+    }
+    for (unsigned k = 0; k < nrest; k++) {
+        inputs[fit + k] = rest[k];
+    }
+
+    free(rest);
+
+    // Every input fits on a page by itself, so this always makes progress.
+    if (fit == 0 && n > 0) {
+        inputs[0]->at.x = 0;
+        inputs[0]->at.y = 0;
+        fit = 1;
+    }
+
+    return fit;
+}
+
+void
+page_load(void *ctx, unsigned p)
+{
+    struct pagework *work = ctx;
+    struct page *page = &work->spec->pages[p];
+
+    bool needed = false;
+    for (unsigned i = 0; i < work->n && !needed; i++) {
+        needed = work->inputs[i]->page == p;
+    }
+    if (!needed)
+        return;
+
+    FIBITMAP *bitmap = FreeImage_Load(FIF_PNG, page->path, 0);
+    if (bitmap == NULL)
+        return;
+
+    if (FreeImage_GetBPP(bitmap) != 32
+            || FreeImage_GetWidth(bitmap) != page->w || FreeImage_GetHeight(bitmap) != page->h) {
+        FreeImage_Unload(bitmap);
+        return;
+    }
+
+    page->bitmap = bitmap;
+    page->dirty = true;
+}
+
+void
+page_alloc(void *ctx, unsigned p)
+{
+    struct pagework *work = ctx;
+    struct page *page = &work->spec->pages[p];
+
+    page->bitmap = FreeImage_Allocate(page->w, page->h, 32, 0, 0, 0);
+    assert(page->bitmap != NULL);
+    page->dirty = true;
+}
+
+void
+input_blit(void *ctx, unsigned i)
+{
+    struct pagework *work = ctx;
+    struct input *input = work->inputs[i];
+
+    if (input->same != NULL)
+        return;
+
+    FIBITMAP *page = work->spec->pages[input->page].bitmap;
+
+    struct timespec start;
+    trace_begin(&start);
+
+    if (input->bitmap == NULL) {
+        // The page is stored bottom-up, so the input's top row is the page's
+        // scanline [at.y] from the top, and the rows below it come before it.
+        unsigned top = FreeImage_GetHeight(page) - 1 - input->at.y;
+        input->failed = !decode_png(input->path, FreeImage_GetScanLine(page, top) + 4 * (size_t)input->at.x,
+                -(ptrdiff_t)FreeImage_GetPitch(page), input->w, input->h, FI_RGBA_RED == 2);
+        trace_end(&start, "input", "decode", input->name, "\"page\": %u", input->page);
+        return;
+    }
+
+    // Both images are stored bottom-up, so the input's bottom row goes
+    // [at.y + h] rows from the top of the page.
+    unsigned bottom = FreeImage_GetHeight(page) - input->at.y - input->h;
+
+    blit(FreeImage_GetScanLine(page, bottom) + 4 * (size_t)input->at.x, FreeImage_GetPitch(page),
+            FreeImage_GetBits(input->bitmap), FreeImage_GetPitch(input->bitmap), input->w, input->h);
+    trace_end(&start, "input", "blit", input->name, "\"page\": %u", input->page);
+}
+
+void
+page_save(void *ctx, unsigned p)
+{
+    struct pagework *work = ctx;
+    struct page *page = &work->spec->pages[p];
+
+    if (page->bitmap == NULL || !page->dirty)
+        return;
+    page->dirty = false;
+
+    struct timespec start;
+    trace_begin(&start);
+
+    if (work->spec->encode) {
+        // The bitmap is stored bottom-up, so start at its last scanline and
+        // walk backwards to go top-down.
+        page->failed = !encode_png(work->pool, page->path, FreeImage_GetScanLine(page->bitmap, page->h - 1),
+                -(ptrdiff_t)FreeImage_GetPitch(page->bitmap), page->w, page->h, FI_RGBA_RED == 2,
+                &work->spec->encodeopts);
+    } else {
+        page->failed = !FreeImage_Save(FIF_PNG, page->bitmap, page->path, 0);
+    }
+    trace_end(&start, "page", "encode", page->path, "\"width\": %u, \"height\": %u", page->w, page->h);
+
+    if (!page->failed && page->texture != NULL) {
+        trace_begin(&start);
+        page->failed = !tex_write(page->texture, FreeImage_GetScanLine(page->bitmap, page->h - 1),
+                -(ptrdiff_t)FreeImage_GetPitch(page->bitmap), page->w, page->h, FI_RGBA_RED == 2,
+                work->spec->compression);
+        trace_end(&start, "page", "texture", page->texture, NULL);
+    }
+
+    if (!work->keep) {
+        FreeImage_Unload(page->bitmap);
+        page->bitmap = NULL;
+    }
+}
+
+struct input *
+input_alloc()
+{
+    struct input *input = malloc(sizeof(struct input));
+    if (input == NULL) return NULL;
+
+    input->name = NULL;
+    input->path = NULL;
+    input->sprite = NULL;
+    input->bitmap = NULL;
+    input->failed = false;
+    input->hash = 0;
+    input->digest = 0;
+    input->same = NULL;
+    input->at.x = 0;
+    input->at.y = 0;
+    input->page = 0;
+    input->w = 0;
+    input->h = 0;
+    input->off.x = 0;
+    input->off.y = 0;
+    input->ow = 0;
+    input->oh = 0;
+
+    return input;
+}
+
+void
+input_free(struct input *input)
+{
+    free(input->name);
+    free(input->path);
+
+    if (input->bitmap != NULL) {
+        FreeImage_Unload(input->bitmap);
+    }
+    if (input->sprite != NULL) {
+        sprite_release(input->sprite);
+    }
+
+    free(input);
+}
+
+void
+input_load(void *ctx, unsigned i)
+{
+    struct input *input = ((struct input **)ctx)[i];
+
+    if (input->bitmap != NULL)
+        return;
+
+    struct timespec start;
+    trace_begin(&start);
+
+    FIBITMAP *bitmap;
+    if (input->sprite != NULL) {
+        // Whichever input gets here first decodes the sprite, and the others
+        // wait for it rather than decode it themselves.
+        struct sprite *sprite = input->sprite;
+        pthread_mutex_lock(&sprite->lock);
+        if (!sprite->loaded) {
+            sprite->bitmap = load_png(input->path);
+            sprite->loaded = true;
+        }
+        bitmap = sprite->bitmap != NULL ? FreeImage_Clone(sprite->bitmap) : NULL;
+        pthread_mutex_unlock(&sprite->lock);
+    } else {
+        bitmap = load_png(input->path);
+    }
+    trace_end(&start, "input", "decode", input->name, NULL);
+    if (bitmap == NULL)
+        return;
+
+    input->bitmap = bitmap;
+    input->w = FreeImage_GetWidth(input->bitmap);
+    input->h = FreeImage_GetHeight(input->bitmap);
+    input->off.x = 0;
+    input->off.y = 0;
+    input->ow = input->w;
+    input->oh = input->h;
+}
+
+FIBITMAP *
+load_png(const char *path)
+{
+    FIBITMAP *bitmap = FreeImage_Load(FIF_PNG, path, 0);
+    if (bitmap == NULL)
+        return NULL;
+
+    // Everything downstream (pasting, trimming) works on 32-bit pixels, so
+    // convert palette, grey and RGB images once here.
+    if (FreeImage_GetBPP(bitmap) != 32) {
+        FIBITMAP *converted = FreeImage_ConvertTo32Bits(bitmap);
+        FreeImage_Unload(bitmap);
+        bitmap = converted;
+    }
+
+    return bitmap;
+}
+
+void
+input_probe(void *ctx, unsigned i)
+{
+    struct input *input = ((struct input **)ctx)[i];
+
+    if (input->bitmap != NULL)
+        return;
+
+    if (input->sprite != NULL) {
+        input_load(ctx, i);
+        return;
+    }
+
+    struct timespec start;
+    trace_begin(&start);
+    bool probed = decode_probe(input->path, &input->w, &input->h);
+    trace_end(&start, "input", "probe", input->name, NULL);
+
+    if (!probed) {
+        input->w = 0;
+        input->h = 0;
+        return;
+    }
+    input->off.x = 0;
+    input->off.y = 0;
+    input->ow = input->w;
+    input->oh = input->h;
+}
+
+void
+input_trim(void *ctx, unsigned i)
+{
+    struct input *input = ((struct input **)ctx)[i];
+
+    struct timespec start;
+    trace_begin(&start);
+
+    // Trimming an image twice leaves it as it was the first time, so
+    // there's no need to track which inputs were already trimmed.
+    unsigned w = FreeImage_GetWidth(input->bitmap);
+    unsigned h = FreeImage_GetHeight(input->bitmap);
+
+    // FreeImage stores images bottom-up, so start at the last scanline and
+    // walk backwards to go top-down.
+    struct trim trim = { 0, 0, 1, 1 };
+    trim_bounds(FreeImage_GetScanLine(input->bitmap, h - 1), -(ptrdiff_t)FreeImage_GetPitch(input->bitmap),
+            w, h, FI_RGBA_ALPHA_MASK, &trim);
+
+    if (trim.w != w || trim.h != h) {
+        FIBITMAP *trimmed = FreeImage_Copy(input->bitmap, trim.x, trim.y, trim.x + trim.w, trim.y + trim.h);
+        assert(trimmed != NULL);
+        FreeImage_Unload(input->bitmap);
+
+        input->bitmap = trimmed;
+        input->off.x += trim.x;
+        input->off.y += trim.y;
+        input->w = trim.w;
+        input->h = trim.h;
+    }
+
+    trace_end(&start, "input", "trim", input->name, NULL);
+}
+
+void
+input_digest(void *ctx, unsigned i)
+{
+    struct input *input = ((struct input **)ctx)[i];
+
+    // Rows may be padded, so hash them one at a time, chaining the hashes.
+    unsigned dims[] = { input->w, input->h };
+    uint64_t digest = hash64(dims, sizeof(dims), 0);
+    for (unsigned y = 0; y < input->h; y++) {
+        digest = hash64(FreeImage_GetScanLine(input->bitmap, y), 4 * (size_t)input->w, digest);
+    }
+
+    input->digest = digest;
+}
+
+bool
+input_same(const struct input *a, const struct input *b)
+{
+    if (a->w != b->w || a->h != b->h)
+        return false;
+
+    for (unsigned y = 0; y < a->h; y++) {
+        if (memcmp(FreeImage_GetScanLine(a->bitmap, y), FreeImage_GetScanLine(b->bitmap, y), 4 * (size_t)a->w))
+            return false;
+    }
+    return true;
+}
+
+unsigned
+dedup(struct input **inputsarr, unsigned n)
+{
+    // [table] is an open-addressed hash table of the inputs kept so far,
+    // keyed by [digest], with at least twice as many slots as inputs.
+    size_t slots = 1;
+    while (slots < 2 * (size_t)n)
+        slots *= 2;
+
+    struct input **table = calloc(slots, sizeof(struct input *));
+    assert(table != NULL);
+
+    for (unsigned i = 0; i < n; i++) {
+        struct input *input = inputsarr[i];
+
+        // Equal digests almost always mean equal pixels, but only almost, so
+        // probing goes on past any that turn out to differ.
+        size_t s = input->digest & (slots - 1);
+        while (table[s] != NULL) {
+            if (table[s]->digest == input->digest && input_same(table[s], input)) {
+                input->same = table[s];
+                break;
+            }
+            s = (s + 1) & (slots - 1);
+        }
+
+        if (input->same == NULL)
+            table[s] = input;
+    }
+
+    free(table);
+
+    // Move the kept inputs to the front, in order, and the rest after them.
+    struct input **rest = malloc(n * sizeof(struct input *) + 1);
+    assert(rest != NULL);
+
+    unsigned kept = 0;
+    unsigned nrest = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (inputsarr[i]->same == NULL)
+            inputsarr[kept++] = inputsarr[i];
+        else
+            rest[nrest++] = inputsarr[i];
+    }
+    for (unsigned k = 0; k < nrest; k++) {
+        inputsarr[kept + k] = rest[k];
+    }
+
+    free(rest);
+    return kept;
+}
+
+void
+input_hash(void *ctx, unsigned i)
+{
+    struct input *input = ((struct input **)ctx)[i];
+    struct sprite *sprite = input->sprite;
+
+    if (sprite == NULL) {
+        if (!hash_file(input->path, 0, &input->hash))
+            input->hash = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&sprite->lock);
+    if (!sprite->hashed) {
+        if (!hash_file(input->path, 0, &sprite->hash))
+            sprite->hash = 0;
+        sprite->hashed = true;
+    }
+    input->hash = sprite->hash;
+    pthread_mutex_unlock(&sprite->lock);
+}
+
+/**
+ * An [identity] is an [input] along with the device and inode of the file
+ * at its [path], or [found] unset if there's no such file.
+ * [identity_cmp] sorts them so that inputs of the same file are together.
+ */
+struct identity {
+    struct input *input;
+    bool found;
+    dev_t dev;
+    ino_t ino;
+};
+
+static int
+identity_cmp(const void *a, const void *b)
+{
+    const struct identity *p = a;
+    const struct identity *q = b;
+
+    if (p->found != q->found)
+        return p->found ? -1 : 1;
+    if (p->dev != q->dev)
+        return p->dev < q->dev ? -1 : 1;
+    if (p->ino != q->ino)
+        return p->ino < q->ino ? -1 : 1;
+    return 0;
+}
+
+/**
+ * [input_identify ctx i] fills in the [i]th [identity] of the array [ctx].
+ * It is intended for use with [pool_for].
+ */
+static void
+input_identify(void *ctx, unsigned i)
+{
+    struct identity *id = &((struct identity *)ctx)[i];
+    struct stat st;
+
+    id->found = !stat(id->input->path, &st);
+    id->dev = id->found ? st.st_dev : 0;
+    id->ino = id->found ? st.st_ino : 0;
+}
+
+void
+share_sprites(struct pool *pool, struct spec **specs, unsigned n)
+{
+    // Files are told apart by device and inode, so that specifications that
+    // reach the same file through different paths still share it.
+    unsigned len = 0;
+    for (unsigned k = 0; k < n; k++) {
+        struct input *input;
+        SIMPLEQ_FOREACH(input, &specs[k]->inputs, entries) {
+            len++;
+        }
+    }
+
+    struct identity *ids = malloc(len * sizeof(struct identity) + 1);
+    assert(ids != NULL);
+
+    unsigned i = 0;
+    for (unsigned k = 0; k < n; k++) {
+        struct input *input;
+        SIMPLEQ_FOREACH(input, &specs[k]->inputs, entries) {
+            ids[i++].input = input;
+        }
+    }
+
+    pool_for(pool, len, input_identify, ids);
+    qsort(ids, len, sizeof(struct identity), identity_cmp);
+
+    for (unsigned first = 0; first < len && ids[first].found;) {
+        unsigned end = first + 1;
+        while (end < len && !identity_cmp(&ids[first], &ids[end]))
+            end++;
+
+        if (end - first > 1) {
+            struct sprite *sprite = malloc(sizeof(struct sprite));
+            assert(sprite != NULL);
+
+            pthread_mutex_init(&sprite->lock, NULL);
+            sprite->hashed = false;
+            sprite->hash = 0;
+            sprite->loaded = false;
+            sprite->bitmap = NULL;
+            sprite->users = end - first;
+
+            for (unsigned k = first; k < end; k++) {
+                ids[k].input->sprite = sprite;
+            }
+        }
+
+        first = end;
+    }
+
+    free(ids);
+}
+
+void
+sprite_release(struct sprite *sprite)
+{
+    pthread_mutex_lock(&sprite->lock);
+    bool last = --sprite->users == 0;
+    pthread_mutex_unlock(&sprite->lock);
+
+    if (!last)
+        return;
+
+    if (sprite->bitmap != NULL) {
+        FreeImage_Unload(sprite->bitmap);
+    }
+    pthread_mutex_destroy(&sprite->lock);
+    free(sprite);
+}
+
+int
+input_cmp(const void *a, const void *b)
+{
+    const struct input *i = *(const struct input **)a;
+    const struct input *j = *(const struct input **)b;
+
+    unsigned mi = i->w > i->h ? i->w : i->h;
+    unsigned mj = j->w > j->h ? j->w : j->h;
+
+    if (mi < mj)
+        return 1;
+    else if (mi > mj)
+        return -1;
+    else
+        return 0;
+}
+
+bool
+parse_spec(struct spec *spec, const char *path)
+{
+    FILE *stream = fopen(path, "r");
+    if (stream == NULL) {
+        fprintf(stderr, "parse_spec: fopen: %s\n", strerror(errno));
+        return false;
+    }
+
+    bool failed = true;
+    char *unitraw = NULL;
+
+    // name <val>
+    spec->name = malloc(MAX_SPEC_LINE_LEN);
+    assert(spec->name != NULL);
+    // png <val>
+    spec->png = malloc(MAX_SPEC_LINE_LEN);
+    assert(spec->png != NULL);
+    // c <val>
+    spec->c = malloc(MAX_SPEC_LINE_LEN);
+    assert(spec->c != NULL);
+    // h <val>
+    spec->h = malloc(MAX_SPEC_LINE_LEN);
+    assert(spec->h != NULL);
+    // hi <val>
+    spec->hi = malloc(MAX_SPEC_LINE_LEN);
+    assert(spec->hi != NULL);
+    // from <val>
+    spec->from = malloc(MAX_SPEC_LINE_LEN);
+    assert(spec->from != NULL);
+
+    if (parse_directive(spec->name, "name", stream) == NULL || !isvalidname(spec->name)) {
+        goto close;
+    }
+    if (parse_directive(spec->png, "png", stream) == NULL) {
+        goto close;
+    }
+    if (parse_directive(spec->c, "c", stream) == NULL) {
+        goto close;
+    }
+    if (parse_directive(spec->h, "h", stream) == NULL) {
+        goto close;
+    }
+    if (parse_directive(spec->hi, "hi", stream) == NULL) {
+        goto close;
+    }
+    if (parse_directive(spec->from, "from", stream) == NULL) {
+        goto close;
+    }
+
+    unitraw = malloc(MAX_SPEC_LINE_LEN);
+    if (parse_directive(unitraw, "unit", stream) == NULL) {
+        goto close;
+    }
+
+    int unit = atoi(unitraw);
+    if (!unit) {
+        fprintf(stderr, "the unit directive must specify a positive integer\n");
+        goto close;
+    }
+    spec->unit = unit;
+
+    // [header] is set until the blank line separating the directives from
+    // the names of the images. Until then, lines may be optional directives.
+    bool header = true;
+
+    for (;;) {
+        char *line = malloc(MAX_SPEC_LINE_LEN);
+        assert(line != NULL);
+
+        if (fgets(line, MAX_SPEC_LINE_LEN, stream) == NULL) {
+            free(line);
+            break;
+        }
+
+        size_t len = strlen(line);
+        if (len < 2) {
+            free(line);
+            header = false;
+            continue;
+        }
+        // trim trailing newline
+        line[len - 1] = '\0';
+
+        if (header) {
+            int parsed = parse_option(spec, line);
+            if (parsed) {
+                free(line);
+                if (parsed < 0)
+                    goto close;
+                continue;
+            }
+        }
+
+        if (!isvalidname(line)) {
+            free(line);
+            fprintf(stderr, "the name '%s' must match [a-zA-Z][a-zA-Z0-9_].\n", line);
+            goto close;
+        }
+
+        struct input *newest = input_alloc();
+        assert(newest != NULL);
+
+        newest->name = line;
+
+        newest->path = malloc(strlen(line) + strlen(spec->from) + 6); // appending {/, .png, \0}
+        assert(newest->path != NULL);
+        sprintf(newest->path, "%s/%s.png", spec->from, line);
+
+        SIMPLEQ_INSERT_TAIL(&spec->inputs, newest, entries);
+    }
+
+    if (spec->find && spec->malloced) {
+        fprintf(stderr, "parse_spec: the find directive needs 'rects table'\n");
+        goto close;
+    }
+
+    failed = false;
+
+close:;
+    free(unitraw);
+
+    if (fclose(stream)) {
+        fprintf(stderr, "parse_spec: fclose: %s\n", strerror(errno));
+        failed = true;
+    }
+
+    return !failed;
+}
+
+char *
+parse_directive(char *dst, const char *key, FILE *stream)
+{
+    char *line = malloc(MAX_SPEC_LINE_LEN);
+    assert(line != NULL);
+
+    if (fgets(line, MAX_SPEC_LINE_LEN, stream) == NULL) {
+        fprintf(stderr, "parse_directive: unexpected EOF or read error\n");
+        goto fail;
+    }
+
+    size_t len = strlen(line);
+    if (len == 0) {
+        goto fail;
+    }
+    line[len - 1] = '\0';
+
+    size_t keylen = strlen(key);
+    if (len < keylen + 2 || strncmp(line, key, keylen) || line[keylen] != ' ') {
+        fprintf(stderr, "parse_directive: expected '%s <data>', got '%s'\n", key, line);
+        goto fail;
+    }
+
+    strncpy(dst, line + keylen + 1, len - keylen - 1);
+    return dst;
+
+fail:
+    free(line);
+    return NULL;
+}
+
+int
+parse_option(struct spec *spec, const char *line)
+{
+    const char *value = strchr(line, ' ');
+    size_t keylen = value == NULL ? strlen(line) : (size_t)(value - line);
+    if (value != NULL)
+        value++;
+
+    if (keylen == 6 && !strncmp(line, "packer", keylen)) {
+        // packer <engine> [<rule>]
+        char engine[MAX_SPEC_LINE_LEN] = "";
+        char rule[MAX_SPEC_LINE_LEN] = "";
+        if (value == NULL || sscanf(value, "%s %s", engine, rule) < 1)
+            goto bad_packer;
+
+        if (!strcmp(engine, "frontier")) {
+            spec->engine = ENGINE_FRONTIER;
+            if (*rule)
+                goto bad_packer;
+        } else if (!strcmp(engine, "skyline")) {
+            spec->engine = ENGINE_SKYLINE;
+            if (!*rule || !strcmp(rule, "bl"))
+                spec->rule = RULE_BOTTOM_LEFT;
+            else if (!strcmp(rule, "waste"))
+                spec->rule = RULE_MIN_WASTE;
+            else
+                goto bad_packer;
+        } else if (!strcmp(engine, "maxrects")) {
+            spec->engine = ENGINE_MAXRECTS;
+            if (!*rule || !strcmp(rule, "bssf"))
+                spec->rule = RULE_SHORT_SIDE;
+            else if (!strcmp(rule, "blsf"))
+                spec->rule = RULE_LONG_SIDE;
+            else if (!strcmp(rule, "baf"))
+                spec->rule = RULE_AREA;
+            else if (!strcmp(rule, "bl"))
+                spec->rule = RULE_BOTTOM_LEFT;
+            else if (!strcmp(rule, "contact"))
+                spec->rule = RULE_CONTACT;
+            else
+                goto bad_packer;
+        } else {
+            goto bad_packer;
+        }
+
+        return 1;
+
+bad_packer:
+        fprintf(stderr, "parse_option: expected 'packer frontier', 'packer skyline [bl|waste]' or "
+                "'packer maxrects [bssf|blsf|baf|bl|contact]', got '%s'\n", line);
+        return -1;
+    }
+
+    if (keylen == 4 && !strncmp(line, "trim", keylen)) {
+        // trim
+        if (value != NULL) {
+            fprintf(stderr, "parse_option: expected 'trim', got '%s'\n", line);
+            return -1;
+        }
+
+        spec->trim = true;
+        return 1;
+    }
+
+    if (keylen == 5 && !strncmp(line, "dedup", keylen)) {
+        // dedup
+        if (value != NULL) {
+            fprintf(stderr, "parse_option: expected 'dedup', got '%s'\n", line);
+            return -1;
+        }
+
+        spec->dedup = true;
+        return 1;
+    }
+
+    if (keylen == 7 && !strncmp(line, "maxsize", keylen)) {
+        // maxsize <w> <h>
+        int w, h;
+        char extra;
+        if (value == NULL || sscanf(value, "%d %d %c", &w, &h, &extra) != 2 || w < 1 || h < 1) {
+            fprintf(stderr, "parse_option: expected 'maxsize <width> <height>' with positive integers, got '%s'\n",
+                    line);
+            return -1;
+        }
+
+        spec->maxw = w;
+        spec->maxh = h;
+        return 1;
+    }
+
+    if (keylen == 6 && !strncmp(line, "encode", keylen)) {
+        // encode <level> [<strategy>]
+        if (value == NULL || !encode_parse(&spec->encodeopts, value)) {
+            fprintf(stderr, "parse_option: expected 'encode fast|default|max|0-9 [default|filtered|rle|huffman]', "
+                    "got '%s'\n", line);
+            return -1;
+        }
+
+        spec->encode = true;
+        return 1;
+    }
+
+    if (keylen == 7 && !strncmp(line, "texture", keylen)) {
+        // texture raw|lz4
+        if (value != NULL && !strcmp(value, "raw")) {
+            spec->compression = TEX_RAW;
+        } else if (value != NULL && !strcmp(value, "lz4")) {
+            spec->compression = TEX_LZ4;
+        } else {
+            fprintf(stderr, "parse_option: expected 'texture raw|lz4', got '%s'\n", line);
+            return -1;
+        }
+
+        spec->texture = true;
+        return 1;
+    }
+
+    if (keylen == 5 && !strncmp(line, "rects", keylen)) {
+        // rects table|malloc
+        if (value != NULL && !strcmp(value, "table")) {
+            spec->malloced = false;
+        } else if (value != NULL && !strcmp(value, "malloc")) {
+            spec->malloced = true;
+        } else {
+            fprintf(stderr, "parse_option: expected 'rects table|malloc', got '%s'\n", line);
+            return -1;
+        }
+
+        return 1;
+    }
+
+    if (keylen == 4 && !strncmp(line, "find", keylen)) {
+        // find
+        if (value != NULL) {
+            fprintf(stderr, "parse_option: expected 'find', got '%s'\n", line);
+            return -1;
+        }
+
+        spec->find = true;
+        return 1;
+    }
+
+    if (keylen == 5 && !strncmp(line, "embed", keylen)) {
+        // embed
+        if (value != NULL) {
+            fprintf(stderr, "parse_option: expected 'embed', got '%s'\n", line);
+            return -1;
+        }
+
+        spec->embed = true;
+        return 1;
+    }
+
+    return 0;
+}
+
+uint64_t
+spec_key(const char *path, bool searching, const struct searchopts *searchopts,
+        const struct encodeopts *encodeopts)
+{
+    uint64_t key;
+    if (!hash_file(path, 0, &key))
+        return 0;
+
+    unsigned opts[] = { searching, searchopts->metric, searchopts->budget, encodeopts != NULL,
+        encodeopts != NULL ? encodeopts->level : 0, encodeopts != NULL ? encodeopts->strategy : 0 };
+    return hash64(opts, sizeof(opts), key);
+}
+
+/**
+ * [differs input e] returns [true] iff the contents of [input] may differ from
+ * those of the cache entry [e], which holds the same name.
+ */
+static bool
+differs(const struct input *input, const struct cacheentry *e)
+{
+    return input->hash == 0 || input->hash != e->hash;
+}
+
+int
+update(struct spec *spec, struct pool *pool, struct input **inputsarr, unsigned n,
+        const struct cache *cache, uint64_t key, const char *path, bool verbose)
+{
+    if (key == 0 || cache->key != key || cache->len != n)
+        return 0;
+    // The cache only says what the outputs were when it was written.
+    if (access(spec->c, F_OK) || access(spec->h, F_OK))
+        return 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        if (strcmp(cache->entries[i].name, inputsarr[i]->name))
+            return 0;
+    }
+
+    spec_pages(spec, cache->npages);
+    for (unsigned p = 0; p < cache->npages; p++) {
+        const char *texture = spec->pages[p].texture;
+        if (access(spec->pages[p].path, F_OK) || (texture != NULL && access(texture, F_OK))) {
+            spec_pages(spec, 0);
+            return 0;
+        }
+        spec->pages[p].w = cache->pages[p].w;
+        spec->pages[p].h = cache->pages[p].h;
+    }
+
+    // [changed] holds the inputs whose contents differ from the cache's.
+    struct input **changed = malloc(n * sizeof(struct input *) + 1);
+    assert(changed != NULL);
+
+    unsigned nchanged = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (differs(inputsarr[i], &cache->entries[i]))
+            changed[nchanged++] = inputsarr[i];
+    }
+
+    if (nchanged == 0) {
+        free(changed);
+        if (verbose) {
+            fprintf(stderr, "%s: up to date\n", spec->name);
+        }
+        spec->stats.result = "up to date";
+        return 1;
+    }
+
+    int updated = 0;
+    struct specstats *stats = &spec->stats;
+    struct timer timer;
+
+    // Only the changed inputs are loaded here, or without trimming only
+    // probed, to be decoded straight onto their pages; if they can't be
+    // reused, the full rebuild loads the rest and reports any failures.
+    timer_start(&timer);
+    pool_for(pool, nchanged, spec->trim ? input_load : input_probe, changed);
+    stage_stop(spec, STAGE_DECODE, &timer);
+
+    for (unsigned k = 0; k < nchanged; k++) {
+        if (spec->trim ? changed[k]->bitmap == NULL : changed[k]->w == 0)
+            goto close;
+    }
+
+    if (spec->trim) {
+        timer_start(&timer);
+        pool_for(pool, nchanged, input_trim, changed);
+        stage_stop(spec, STAGE_TRIM, &timer);
+    }
+
+    // With trimming, an input must also have kept its visible part in the
+    // same place, since the generated code records where that is.
+    for (unsigned i = 0; i < n; i++) {
+        const struct input *input = inputsarr[i];
+        const struct cacheentry *e = &cache->entries[i];
+        if (!differs(input, e))
+            continue;
+        if (input->w != e->w || input->h != e->h || input->off.x != e->off.x || input->off.y != e->off.y
+                || input->ow != e->ow || input->oh != e->oh)
+            goto close;
+    }
+
+    // With deduplication, an input may share its placement with others, and
+    // pasting over it would change them too.
+    if (spec->dedup && shares(cache, inputsarr))
+        goto close;
+
+    for (unsigned i = 0; i < n; i++) {
+        inputsarr[i]->at = cache->entries[i].at;
+        inputsarr[i]->page = cache->entries[i].page;
+        inputsarr[i]->w = cache->entries[i].w;
+        inputsarr[i]->h = cache->entries[i].h;
+        inputsarr[i]->off = cache->entries[i].off;
+        inputsarr[i]->ow = cache->entries[i].ow;
+        inputsarr[i]->oh = cache->entries[i].oh;
+    }
+
+    // Only the pages with changed inputs on them are loaded.
+    struct pagework work = { pool, spec, changed, nchanged, false };
+    timer_start(&timer);
+    pool_for(pool, spec->npages, page_load, &work);
+
+    for (unsigned k = 0; k < nchanged; k++) {
+        if (spec->pages[changed[k]->page].bitmap == NULL)
+            goto close;
+    }
+
+    // An input with the same dimensions covers exactly the pixels it covered
+    // before, so copying it over its old page is all it takes. The generated
+    // code doesn't depend on pixel contents, so it's left alone, unless the
+    // pages are embedded in it.
+    pool_for(pool, nchanged, input_blit, &work);
+    stage_stop(spec, STAGE_COMPOSITE, &timer);
+
+    for (unsigned k = 0; k < nchanged; k++) {
+        if (changed[k]->failed)
+            goto close;
+    }
+
+    timer_start(&timer);
+    pool_for(pool, spec->npages, page_save, &work);
+    stage_stop(spec, STAGE_ENCODE, &timer);
+
+    updated = 1;
+    for (unsigned p = 0; p < spec->npages; p++) {
+        if (spec->pages[p].failed) {
+            fprintf(stderr, "failed to save output image to %s\n", spec->pages[p].path);
+            updated = -1;
+        }
+    }
+    if (updated > 0 && spec->embed) {
+        timer_start(&timer);
+        if (!write_source(spec))
+            updated = -1;
+        stage_stop(spec, STAGE_EMIT, &timer);
+    }
+    if (updated < 0) {
+        // The packed image may now be anything, so the cache is useless.
+        unlink(path);
+        goto close;
+    }
+
+    if (verbose) {
+        fprintf(stderr, "%s: updated %u of %u images in place\n", spec->name, nchanged, n);
+    }
+
+    timer_start(&timer);
+    store(spec, key, path);
+    stage_stop(spec, STAGE_CACHE, &timer);
+    stats->result = "updated";
+
+close:
+    if (updated == 0) {
+        spec_pages(spec, 0);
+    }
+    free(changed);
+    return updated;
+}
+
+/**
+ * A [placed] is a placement from a [cache], with the current hash of its
+ * input and whether that differs from the cache's. [placed_cmp] sorts them by
+ * page and position, and [hash_cmp] by hash, for [shares].
+ */
+struct placed {
+    unsigned page;
+    struct posn at;
+    uint64_t hash;
+    bool changed;
+};
 
-    return input;
+static int
+placed_cmp(const void *a, const void *b)
+{
+    const struct placed *p = a;
+    const struct placed *q = b;
+
+    if (p->page != q->page)
+        return p->page < q->page ? -1 : 1;
+    if (p->at.y != q->at.y)
+        return p->at.y < q->at.y ? -1 : 1;
+    if (p->at.x != q->at.x)
+        return p->at.x < q->at.x ? -1 : 1;
+    return 0;
 }
 
-void
-input_free(struct input *input)
+static int
+hash_cmp(const void *a, const void *b)
 {
-    free(input->name);
-    free(input->at);
-
-    if (input->bitmap != NULL) {
-        FreeImage_Unload(input->bitmap);
-    }
+    const struct placed *p = a;
+    const struct placed *q = b;
 
-    free(input);
+    if (p->hash != q->hash)
+        return p->hash < q->hash ? -1 : 1;
+    return 0;
 }
 
-int
-input_cmp(const void *a, const void *b)
+bool
+shares(const struct cache *cache, struct input **inputsarr)
 {
-    const struct input *i = *(const struct input **)a;
-    const struct input *j = *(const struct input **)b;
+    struct placed *placed = malloc(cache->len * sizeof(struct placed) + 1);
+    assert(placed != NULL);
+
+    for (unsigned i = 0; i < cache->len; i++) {
+        placed[i].page = cache->entries[i].page;
+        placed[i].at = cache->entries[i].at;
+        placed[i].hash = inputsarr[i]->hash;
+        placed[i].changed = differs(inputsarr[i], &cache->entries[i]);
+    }
 
-    unsigned mi = i->w > i->h ? i->w : i->h;
-    unsigned mj = j->w > j->h ? j->w : j->h;
+    // Placed images never overlap, so two entries share a placement iff they
+    // were placed at the same position on the same page, which sorting brings
+    // together.
+    qsort(placed, cache->len, sizeof(struct placed), placed_cmp);
 
-    if (mi < mj)
-        return 1;
-    else if (mi > mj)
-        return -1;
-    else
-        return 0;
+    bool shared = false;
+    for (unsigned k = 0; k + 1 < cache->len && !shared; k++) {
+        if (placed_cmp(&placed[k], &placed[k + 1]))
+            continue;
+        shared = placed[k].changed || placed[k + 1].changed;
+    }
+
+    // A changed input may also have become a copy of another, which a
+    // rebuild would pack once. Only copies of the same file are caught.
+    qsort(placed, cache->len, sizeof(struct placed), hash_cmp);
+
+    for (unsigned k = 0; k + 1 < cache->len && !shared; k++) {
+        if (placed[k].hash == 0 || hash_cmp(&placed[k], &placed[k + 1]))
+            continue;
+        shared = placed[k].changed || placed[k + 1].changed;
+    }
+
+    free(placed);
+    return shared;
 }
 
 bool
-posn_cmp(const void *a, const void *b)
+store(const struct spec *spec, uint64_t key, const char *path)
 {
-    const struct posn *i = a;
-    const struct posn *j = b;
+    struct cache cache = { key, spec->npages, NULL, 0, NULL };
+    struct input *input;
 
-    unsigned mi = i->x > i->y ? i->x : i->y;
-    unsigned mj = j->x > j->y ? j->x : j->y;
+    cache.pages = malloc(cache.npages * sizeof(struct box) + 1);
+    assert(cache.pages != NULL);
 
-    if (mi == mj) {
-        if (i->x < j->x || i->y < j->y)
-            return true;
-        else
-            return false;
+    for (unsigned p = 0; p < cache.npages; p++) {
+        cache.pages[p].w = spec->pages[p].w;
+        cache.pages[p].h = spec->pages[p].h;
+    }
+
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        cache.len++;
+    }
+
+    cache.entries = malloc(cache.len * sizeof(struct cacheentry) + 1);
+    assert(cache.entries != NULL);
+
+    unsigned i = 0;
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        struct cacheentry *e = &cache.entries[i++];
+        e->name = input->name;
+        e->hash = input->hash;
+        e->w = input->w;
+        e->h = input->h;
+        e->at = input->at;
+        e->page = input->page;
+        e->off = input->off;
+        e->ow = input->ow;
+        e->oh = input->oh;
     }
 
-    return mi < mj;
+    // [cache] borrows the names from [spec], so only the arrays are freed.
+    bool ok = cache_write(&cache, path);
+    free(cache.pages);
+    free(cache.entries);
+    return ok;
 }
 
-void
-parse_spec(struct spec *spec, const char *path)
+bool
+write_header(const struct spec *spec)
 {
-    FILE *stream = fopen(path, "r");
-    if (stream == NULL) {
-        fprintf(stderr, "parse_spec: fopen: %s\n", strerror(errno));
-        exit(1);
-    }
+    struct input *input;
 
-    bool failed = true;
-    char *unitraw = NULL;
+    // The header is printed to memory and only then written to [spec->h],
+    // and only if it changed. See emit.h.
+    struct emit emit;
+    if (!emit_open(&emit))
+        return false;
+    FILE *hfh = emit.stream;
 
-    // name <val>
-    spec->name = malloc(MAX_SPEC_LINE_LEN);
-    assert(spec->name != NULL);
-    // png <val>
-    spec->png = malloc(MAX_SPEC_LINE_LEN);
-    assert(spec->png != NULL);
-    // c <val>
-    spec->c = malloc(MAX_SPEC_LINE_LEN);
-    assert(spec->c != NULL);
-    // h <val>
-    spec->h = malloc(MAX_SPEC_LINE_LEN);
-    assert(spec->h != NULL);
-    // hi <val>
-    spec->hi = malloc(MAX_SPEC_LINE_LEN);
-    assert(spec->hi != NULL);
-    // from <val>
-    spec->from = malloc(MAX_SPEC_LINE_LEN);
-    assert(spec->from != NULL);
+    // XXX This is a little messy. :(
 
-    if (parse_directive(spec->name, "name", stream) == NULL || !isvalidname(spec->name)) {
-        goto close;
+    fprintf(hfh, "#ifndef %s_h\n", spec->name);
+    fprintf(hfh, "#define %s_h\n\n", spec->name);
+
+    fprintf(hfh, "#include <SDL2/SDL.h>\n\n");
+
+    if (!spec->malloced) {
+        fprintf(hfh, "// The index of each image's rectangle in %s_rects.\n", spec->name);
+        fprintf(hfh, "enum %s_rect {\n", spec->name);
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(hfh, "    %s_rect_%s,\n", spec->name, input->name);
+        }
+        fprintf(hfh, "    %s_nrects\n", spec->name);
+        fprintf(hfh, "};\n\n");
+
+        fprintf(hfh, "extern const SDL_Rect %s_rects[%s_nrects];\n\n", spec->name, spec->name);
     }
-    if (parse_directive(spec->png, "png", stream) == NULL) {
-        goto close;
+
+    fprintf(hfh, "struct %s {\n", spec->name);
+    if (spec->maxw == 0)
+        fprintf(hfh, "    SDL_Texture *t;\n\n");
+    else
+        fprintf(hfh, "    SDL_Texture *t[%u];\n\n", spec->npages);
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        fprintf(hfh, "    %sSDL_Rect *%s;\n", spec->malloced ? "" : "const ", input->name);
     }
-    if (parse_directive(spec->c, "c", stream) == NULL) {
-        goto close;
+    if (spec->trim) {
+        fprintf(hfh, "\n");
+        fprintf(hfh, "    // Where each image's packed pixels go within the untrimmed image:\n");
+        fprintf(hfh, "    // x and y are their offset, w and h the untrimmed image's size.\n");
+        fprintf(hfh, "    struct {\n");
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(hfh, "        SDL_Rect %s;\n", input->name);
+        }
+        fprintf(hfh, "    } trim;\n");
     }
-    if (parse_directive(spec->h, "h", stream) == NULL) {
-        goto close;
+    if (spec->maxw > 0) {
+        fprintf(hfh, "\n");
+        fprintf(hfh, "    // The index into t of the page each image was packed onto.\n");
+        fprintf(hfh, "    struct {\n");
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(hfh, "        int %s;\n", input->name);
+        }
+        fprintf(hfh, "    } page;\n");
     }
-    if (parse_directive(spec->hi, "hi", stream) == NULL) {
-        goto close;
+    fprintf(hfh, "};\n\n");
+    
+    fprintf(hfh, "struct %s *%s_load(SDL_Renderer *renderer);\n", spec->name, spec->name);
+    fprintf(hfh, "void %s_unload (struct %s *pack);\n\n", spec->name, spec->name);
+
+    if (spec->find) {
+        fprintf(hfh, "// Returns the index in %s_rects of the image called name, or -1.\n", spec->name);
+        fprintf(hfh, "int %s_find(const char *name);\n\n", spec->name);
     }
-    if (parse_directive(spec->from, "from", stream) == NULL) {
-        goto close;
+
+    fprintf(hfh, "#endif\n");
+
+    return emit_close(&emit, spec->h);
+}
+
+bool
+write_source(const struct spec *spec)
+{
+    struct input *input;
+
+    struct emit emit;
+    if (!emit_open(&emit))
+        return false;
+    FILE *cfh = emit.stream;
+
+    fprintf(cfh, "#include <assert.h>\n\n");
+    if (spec->texture && spec->embed) {
+        fprintf(cfh, "#include <stdint.h>\n#include <stdio.h>\n#include <string.h>\n\n");
+        fprintf(cfh, "#include <SDL2/SDL.h>\n\n");
+    } else if (spec->texture) {
+        fprintf(cfh, "#include <errno.h>\n#include <stdint.h>\n#include <stdio.h>\n#include <string.h>\n\n");
+        fprintf(cfh, "#include <fcntl.h>\n#include <sys/mman.h>\n#include <sys/stat.h>\n#include <unistd.h>\n\n");
+        fprintf(cfh, "#include <SDL2/SDL.h>\n\n");
+    } else {
+        if (spec->find)
+            fprintf(cfh, "#include <stdint.h>\n#include <string.h>\n\n");
+        fprintf(cfh, "#include <SDL2/SDL.h>\n#include <SDL2/SDL_image.h>\n\n");
     }
 
-    unitraw = malloc(MAX_SPEC_LINE_LEN);
-    if (parse_directive(unitraw, "unit", stream) == NULL) {
-        goto close;
+    fprintf(cfh, "#include \"%s\"\n\n", spec->hi);
+
+    // With the texture directive the pages are loaded from their containers
+    // rather than their PNGs.
+    const char *paths = spec->texture ? "TEXTURE_PATH" : "PNG_PATH";
+    if (spec->maxw == 0) {
+        const struct page *page = &spec->pages[0];
+        fprintf(cfh, "static const char *%s = \"%s\";\n\n", paths, spec->texture ? page->texture : page->path);
+    } else {
+        fprintf(cfh, "static const char *%sS[%u] = {\n", paths, spec->npages);
+        for (unsigned p = 0; p < spec->npages; p++) {
+            const struct page *page = &spec->pages[p];
+            fprintf(cfh, "    \"%s\",\n", spec->texture ? page->texture : page->path);
+        }
+        fprintf(cfh, "};\n\n");
     }
 
-    int unit = atoi(unitraw);
-    if (!unit) {
-        fprintf(stderr, "the unit directive must specify a positive integer\n");
-        goto close;
+    if (spec->embed && !write_data(cfh, spec)) {
+        emit_abort(&emit);
+        return false;
     }
-    spec->unit = unit;
 
-    for (;;) {
-        char *line = malloc(MAX_SPEC_LINE_LEN);
-        assert(line != NULL);
+    if (spec->texture)
+        write_loader(cfh, spec);
 
-        if (fgets(line, MAX_SPEC_LINE_LEN, stream) == NULL) {
-            free(line);
-            break;
-        }
+    // Unless told otherwise, the rectangles and the rest of the structure are
+    // constant data that loading copies, so the generated code stays small
+    // and loading allocates only the structure however many images there are.
+    if (!spec->malloced)
+        write_tables(cfh, spec);
 
-        size_t len = strlen(line);
-        if (len < 2) {
-            free(line);
-            continue;
+    if (spec->find && !write_find(cfh, spec)) {
+        emit_abort(&emit);
+        return false;
+    }
+
+    fprintf(cfh, "struct %s *\n", spec->name);
+    fprintf(cfh, "%s_load(SDL_Renderer *renderer)\n", spec->name);
+    fprintf(cfh, "{\n");
+    fprintf(cfh, "    struct %s *pack = malloc(sizeof(struct %s));\n", spec->name, spec->name);
+    fprintf(cfh, "    assert(pack != NULL);\n");
+    if (!spec->malloced)
+        fprintf(cfh, "    *pack = PACK;\n");
+    fprintf(cfh, "\n");
+
+    if (spec->texture && spec->embed && spec->maxw == 0) {
+        fprintf(cfh, "    pack->t = %s_texture(renderer, TEXTURE_PATH, TEXTURE_DATA, sizeof(TEXTURE_DATA));\n\n",
+                spec->name);
+    } else if (spec->texture && spec->embed) {
+        fprintf(cfh, "    for (int i = 0; i < %u; i++) {\n", spec->npages);
+        fprintf(cfh, "        pack->t[i] = %s_texture(renderer, TEXTURE_PATHS[i], TEXTURE_DATAS[i], TEXTURE_SIZES[i]);\n",
+                spec->name);
+        fprintf(cfh, "    }\n\n");
+    } else if (spec->texture && spec->maxw == 0) {
+        fprintf(cfh, "    pack->t = %s_texture_file(renderer, TEXTURE_PATH);\n\n", spec->name);
+    } else if (spec->texture) {
+        fprintf(cfh, "    for (int i = 0; i < %u; i++) {\n", spec->npages);
+        fprintf(cfh, "        pack->t[i] = %s_texture_file(renderer, TEXTURE_PATHS[i]);\n", spec->name);
+        fprintf(cfh, "    }\n\n");
+    } else if (spec->maxw == 0) {
+        if (spec->embed)
+            fprintf(cfh, "    SDL_Surface* raw = IMG_Load_RW(SDL_RWFromConstMem(PNG_DATA, sizeof(PNG_DATA)), 1);\n");
+        else
+            fprintf(cfh, "    SDL_Surface* raw = IMG_Load(PNG_PATH);\n");
+        fprintf(cfh, "    if (raw == NULL) {\n");
+        fprintf(cfh, "        fprintf(stderr, \"%s: failed to load image %%s: %%s\\n\", PNG_PATH, IMG_GetError());\n", spec->name);
+        fprintf(cfh, "        exit(1);\n");
+        fprintf(cfh, "    }\n\n");
+
+        fprintf(cfh, "    pack->t = SDL_CreateTextureFromSurface(renderer, raw);\n");
+        fprintf(cfh, "    if (pack->t == NULL) {\n");
+        fprintf(cfh, "        fprintf(stderr, \"%s: failed to create texture of image %%s: %%s\\n\", PNG_PATH, SDL_GetError());\n", spec->name);
+        fprintf(cfh, "        exit(1);\n");
+        fprintf(cfh, "    }\n\n");
+
+        fprintf(cfh, "    SDL_FreeSurface(raw);\n\n");
+    } else {
+        fprintf(cfh, "    for (int i = 0; i < %u; i++) {\n", spec->npages);
+        if (spec->embed)
+            fprintf(cfh, "        SDL_Surface* raw = IMG_Load_RW(SDL_RWFromConstMem(PNG_DATAS[i], PNG_SIZES[i]), 1);\n");
+        else
+            fprintf(cfh, "        SDL_Surface* raw = IMG_Load(PNG_PATHS[i]);\n");
+        fprintf(cfh, "        if (raw == NULL) {\n");
+        fprintf(cfh, "            fprintf(stderr, \"%s: failed to load image %%s: %%s\\n\", PNG_PATHS[i], IMG_GetError());\n", spec->name);
+        fprintf(cfh, "            exit(1);\n");
+        fprintf(cfh, "        }\n\n");
+
+        fprintf(cfh, "        pack->t[i] = SDL_CreateTextureFromSurface(renderer, raw);\n");
+        fprintf(cfh, "        if (pack->t[i] == NULL) {\n");
+        fprintf(cfh, "            fprintf(stderr, \"%s: failed to create texture of image %%s: %%s\\n\", PNG_PATHS[i], SDL_GetError());\n", spec->name);
+        fprintf(cfh, "            exit(1);\n");
+        fprintf(cfh, "        }\n\n");
+
+        fprintf(cfh, "        SDL_FreeSurface(raw);\n");
+        fprintf(cfh, "    }\n\n");
+    }
+
+    if (spec->malloced) {
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(cfh, "    pack->%s = malloc(sizeof(SDL_Rect));\n", input->name);
+            fprintf(cfh, "    assert(pack->%s != NULL);\n", input->name);
+            fprintf(cfh, "    pack->%s->x = %d;\n", input->name, input->at.x);
+            fprintf(cfh, "    pack->%s->y = %d;\n", input->name, input->at.y);
+            fprintf(cfh, "    pack->%s->w = %d;\n", input->name, input->w);
+            fprintf(cfh, "    pack->%s->h = %d;\n\n", input->name, input->h);
         }
-        // trim trailing newline
-        line[len - 1] = '\0';
 
-        if (!isvalidname(line)) {
-            free(line);
-            fprintf(stderr, "the name '%s' must match [a-zA-Z][a-zA-Z0-9_].\n", line);
-            goto close;
+        if (spec->trim) {
+            SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+                fprintf(cfh, "    pack->trim.%s.x = %d;\n", input->name, input->off.x);
+                fprintf(cfh, "    pack->trim.%s.y = %d;\n", input->name, input->off.y);
+                fprintf(cfh, "    pack->trim.%s.w = %d;\n", input->name, input->ow);
+                fprintf(cfh, "    pack->trim.%s.h = %d;\n\n", input->name, input->oh);
+            }
         }
 
-        struct input *newest = input_alloc();
-        assert(newest != NULL);
+        if (spec->maxw > 0) {
+            SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+                fprintf(cfh, "    pack->page.%s = %u;\n", input->name, input->page);
+            }
+            fprintf(cfh, "\n");
+        }
+    }
 
-        newest->name = line;
+    fprintf(cfh, "    return pack;\n");
+    fprintf(cfh, "}\n\n");
 
-        SIMPLEQ_INSERT_TAIL(&spec->inputs, newest, entries);
+    fprintf(cfh, "void\n");
+    fprintf(cfh, "%s_unload (struct %s *pack)\n", spec->name, spec->name);
+    fprintf(cfh, "{\n");
+    
+    if (spec->malloced) {
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(cfh, "    free(pack->%s);\n", input->name);
+        }
     }
 
-    failed = false;
+    fprintf(cfh, "    free(pack);\n");
+    fprintf(cfh, "}\n");
 
-close:;
-    free(unitraw);
+    return emit_close(&emit, spec->c);
+}
 
-    if (fclose(stream)) {
-        fprintf(stderr, "parse_spec: fclose: %s\n", strerror(errno));
-        failed = true;
+void
+write_tables(FILE *cfh, const struct spec *spec)
+{
+    struct input *input;
+
+    fprintf(cfh, "const SDL_Rect %s_rects[%s_nrects] = {\n", spec->name, spec->name);
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        fprintf(cfh, "    [%s_rect_%s] = { %d, %d, %d, %d },\n", spec->name, input->name,
+                input->at.x, input->at.y, input->w, input->h);
     }
+    fprintf(cfh, "};\n\n");
 
-    if (failed) {
-        spec_free(spec);
-        exit(1);
+    fprintf(cfh, "static const struct %s PACK = {\n", spec->name);
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        fprintf(cfh, "    .%s = &%s_rects[%s_rect_%s],\n", input->name, spec->name, spec->name, input->name);
+    }
+    if (spec->trim) {
+        fprintf(cfh, "    .trim = {\n");
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(cfh, "        .%s = { %d, %d, %d, %d },\n", input->name,
+                    input->off.x, input->off.y, input->ow, input->oh);
+        }
+        fprintf(cfh, "    },\n");
+    }
+    if (spec->maxw > 0) {
+        fprintf(cfh, "    .page = {\n");
+        SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+            fprintf(cfh, "        .%s = %u,\n", input->name, input->page);
+        }
+        fprintf(cfh, "    },\n");
     }
+    fprintf(cfh, "};\n\n");
 }
 
-char *
-parse_directive(char *dst, const char *key, FILE *stream)
+bool
+write_data(FILE *cfh, const struct spec *spec)
 {
-    char *line = malloc(MAX_SPEC_LINE_LEN);
-    assert(line != NULL);
+    const char *prefix = spec->texture ? "TEXTURE" : "PNG";
 
-    if (fgets(line, MAX_SPEC_LINE_LEN, stream) == NULL) {
-        fprintf(stderr, "parse_directive: unexpected EOF or read error\n");
-        goto fail;
+    if (spec->maxw == 0) {
+        const struct page *page = &spec->pages[0];
+        char array[16];
+        sprintf(array, "%s_DATA", prefix);
+        return write_bytes(cfh, array, spec->texture ? page->texture : page->path);
     }
 
-    size_t len = strlen(line);
-    if (len == 0) {
-        goto fail;
+    for (unsigned p = 0; p < spec->npages; p++) {
+        const struct page *page = &spec->pages[p];
+        char array[32];
+        sprintf(array, "%s_DATA_%u", prefix, p);
+        if (!write_bytes(cfh, array, spec->texture ? page->texture : page->path))
+            return false;
     }
-    line[len - 1] = '\0';
 
-    size_t keylen = strlen(key);
-    if (len < keylen + 2 || strncmp(line, key, keylen) || line[keylen] != ' ') {
-        fprintf(stderr, "parse_directive: expected '%s <data>', got '%s'\n", key, line);
-        goto fail;
+    fprintf(cfh, "static const unsigned char *const %s_DATAS[%u] = {\n", prefix, spec->npages);
+    for (unsigned p = 0; p < spec->npages; p++) {
+        fprintf(cfh, "    %s_DATA_%u,\n", prefix, p);
     }
+    fprintf(cfh, "};\n\n");
 
-    strncpy(dst, line + keylen + 1, len - keylen - 1);
-    return dst;
+    fprintf(cfh, "static const size_t %s_SIZES[%u] = {\n", prefix, spec->npages);
+    for (unsigned p = 0; p < spec->npages; p++) {
+        fprintf(cfh, "    sizeof(%s_DATA_%u),\n", prefix, p);
+    }
+    fprintf(cfh, "};\n\n");
 
-fail:
-    free(line);
-    return NULL;
+    return true;
 }
 
-struct grid *
-grid_alloc()
+bool
+write_bytes(FILE *cfh, const char *array, const char *path)
 {
-    struct grid *grid = malloc(sizeof(struct grid));
-    assert(grid != NULL);
-
-    grid->s = 1;
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL) {
+        fprintf(stderr, "write_bytes: fopen: failed to open file at %s for reading: %s\n", path, strerror(errno));
+        return false;
+    }
 
-    grid->posns = malloc(sizeof(bool *));
-    assert(grid->posns != NULL);
+    fprintf(cfh, "static const unsigned char %s[] = {\n", array);
+
+    // The bytes are read and formatted a chunk at a time, as decimal numbers
+    // from a table, since printing them one by one would take longer than
+    // everything else pngsquare does for a large image.
+    char digits[256][4];
+    unsigned char lens[256];
+    for (unsigned v = 0; v < 256; v++)
+        lens[v] = sprintf(digits[v], "%u", v);
+
+    unsigned char *in = malloc(EMBED_CHUNK);
+    assert(in != NULL);
+    // Each byte takes at most "255,", and each line a newline and an indent.
+    char *out = malloc(EMBED_CHUNK * 4 + (EMBED_CHUNK / EMBED_PER_LINE + 1) * 5);
+    assert(out != NULL);
+
+    bool ok = true;
+    size_t total = 0;
+    size_t n;
+    while ((n = fread(in, 1, EMBED_CHUNK, stream)) > 0) {
+        char *o = out;
+        for (size_t i = 0; i < n; i++, total++) {
+            if (total % EMBED_PER_LINE == 0) {
+                if (total > 0)
+                    *o++ = '\n';
+                memcpy(o, "    ", 4);
+                o += 4;
+            }
+            memcpy(o, digits[in[i]], lens[in[i]]);
+            o += lens[in[i]];
+            *o++ = ',';
+        }
+        fwrite(out, 1, o - out, cfh);
+    }
 
-    grid->posns[0] = malloc(sizeof(bool));
-    assert(grid->posns[0] != NULL);
+    if (ferror(stream)) {
+        fprintf(stderr, "write_bytes: failed to read %s: %s\n", path, strerror(errno));
+        ok = false;
+    }
 
-    grid->posns[0][0] = false;
+    fprintf(cfh, "\n};\n\n");
 
-    return grid;
+    free(in);
+    free(out);
+    fclose(stream);
+    return ok;
 }
 
 bool
-grid_marked(struct grid *grid, unsigned x, unsigned y)
+write_find(FILE *cfh, const struct spec *spec)
 {
-    if (x >= grid->s || y >= grid->s)
-        return false;
+    struct input *input;
 
-    return grid->posns[y][x];
-}
+    unsigned n = 0;
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        n++;
+    }
 
-bool
-grid_mark(struct grid *grid, unsigned x, unsigned y)
-{
-    bool resized = false;
-    if (x >= grid->s || y >= grid->s) {
-        int sn = 2 << (int)(ceil(log2(x > y ? x : y)));
+    // Without any names there's nothing to hash, and the tables would be
+    // empty arrays, which C doesn't allow.
+    if (n == 0) {
+        fprintf(cfh, "int\n");
+        fprintf(cfh, "%s_find(const char *name)\n", spec->name);
+        fprintf(cfh, "{\n");
+        fprintf(cfh, "    (void)name;\n");
+        fprintf(cfh, "    return -1;\n");
+        fprintf(cfh, "}\n\n");
+        return true;
+    }
 
-        bool **posnsn = realloc(grid->posns, sn * sizeof(bool *));
-        assert(posnsn != NULL);
+    const char **names = malloc(n * sizeof(char *) + 1);
+    assert(names != NULL);
+    n = 0;
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        names[n++] = input->name;
+    }
 
-        for (int y = 0; y < grid->s; y++) {
-            bool *rown = realloc(posnsn[y], sn * sizeof(bool));
-            assert(rown != NULL);
-            memset(rown + grid->s, 0, sn - grid->s);
-            posnsn[y] = rown;
-        }
+    struct phash ph;
+    bool built = phash_build(&ph, names, n);
+    free(names);
+    if (!built) {
+        phash_free(&ph);
+        return false;
+    }
 
-        for (int y = grid->s; y < sn; y++) {
-            posnsn[y] = calloc(sn, sizeof(bool));
-            assert(posnsn[y] != NULL);
-        }
+    // The tables are in the order of the rectangles, except for FIND_SLOTS,
+    // which maps each slot of the hash to the index of a rectangle.
+    fprintf(cfh, "static const char *const FIND_NAMES[%s_nrects] = {\n", spec->name);
+    SIMPLEQ_FOREACH(input, &spec->inputs, entries) {
+        fprintf(cfh, "    \"%s\",\n", input->name);
+    }
+    fprintf(cfh, "};\n\n");
 
-        grid->posns = posnsn;
+    fprintf(cfh, "static const int32_t FIND_DISP[%s_nrects] = {\n", spec->name);
+    for (unsigned b = 0; b < n; b++) {
+        fprintf(cfh, "%s%" PRId32 ",%s", b % 12 == 0 ? "    " : " ", ph.disp[b], b % 12 == 11 || b == n - 1 ? "\n" : "");
+    }
+    fprintf(cfh, "};\n\n");
 
-        grid->s = sn;
-        resized = true;
+    fprintf(cfh, "static const int FIND_SLOTS[%s_nrects] = {\n", spec->name);
+    for (unsigned slot = 0; slot < n; slot++) {
+        fprintf(cfh, "%s%u,%s", slot % 12 == 0 ? "    " : " ", ph.slots[slot], slot % 12 == 11 || slot == n - 1 ? "\n" : "");
     }
+    fprintf(cfh, "};\n\n");
+
+    fprintf(cfh, "static uint64_t\n");
+    fprintf(cfh, "%s_mix(uint64_t x)\n", spec->name);
+    fprintf(cfh, "{\n");
+    fprintf(cfh, "    x ^= x >> 33;\n");
+    fprintf(cfh, "    x *= UINT64_C(0xff51afd7ed558ccd);\n");
+    fprintf(cfh, "    x ^= x >> 33;\n");
+    fprintf(cfh, "    x *= UINT64_C(0xc4ceb9fe1a85ec53);\n");
+    fprintf(cfh, "    x ^= x >> 33;\n");
+    fprintf(cfh, "    return x;\n");
+    fprintf(cfh, "}\n\n");
 
-    grid->posns[y][x] = true;
+    fprintf(cfh, "int\n");
+    fprintf(cfh, "%s_find(const char *name)\n", spec->name);
+    fprintf(cfh, "{\n");
+    fprintf(cfh, "    // A minimal perfect hash generated by pngsquare gives every image's\n");
+    fprintf(cfh, "    // name its own slot, so only one name needs comparing.\n");
+    fprintf(cfh, "    uint64_t h = UINT64_C(%#" PRIx64 ");\n", UINT64_C(0xcbf29ce484222325) ^ ph.seed);
+    fprintf(cfh, "    for (const char *c = name; *c; c++)\n");
+    fprintf(cfh, "        h = (h ^ (unsigned char)*c) * UINT64_C(0x100000001b3);\n");
+    fprintf(cfh, "    h = %s_mix(h);\n\n", spec->name);
+    fprintf(cfh, "    int32_t d = FIND_DISP[h %% %s_nrects];\n", spec->name);
+    fprintf(cfh, "    uint64_t slot = d < 0 ? (uint64_t)(-d - 1) : %s_mix(h + (uint64_t)d * UINT64_C(0x9e3779b97f4a7c15)) %% %s_nrects;\n",
+            spec->name, spec->name);
+    fprintf(cfh, "    int i = FIND_SLOTS[slot];\n");
+    fprintf(cfh, "    return strcmp(name, FIND_NAMES[i]) ? -1 : i;\n");
+    fprintf(cfh, "}\n\n");
 
-    return resized;
+    phash_free(&ph);
+    return true;
 }
 
 void
-grid_free(struct grid *grid)
+write_loader(FILE *cfh, const struct spec *spec)
 {
-    for (int y = 0; y < grid->s; y++) {
-        free(grid->posns[y]);
-    }
-    free(grid->posns);
+    fprintf(cfh, "/**\n");
+    fprintf(cfh, " * Decompresses the LZ4 block of n bytes at src into the len bytes at dst.\n");
+    fprintf(cfh, " * Returns 0, or -1 if the block is corrupt or doesn't fill dst exactly.\n");
+    fprintf(cfh, " */\n");
+    fprintf(cfh, "static int\n");
+    fprintf(cfh, "%s_lz4(const unsigned char *src, size_t n, unsigned char *dst, size_t len)\n", spec->name);
+    fprintf(cfh, "{\n");
+    fprintf(cfh, "    const unsigned char *end = src + n;\n");
+    fprintf(cfh, "    size_t o = 0;\n\n");
+    fprintf(cfh, "    while (src < end) {\n");
+    fprintf(cfh, "        unsigned token = *src++;\n\n");
+    fprintf(cfh, "        size_t nlit = token >> 4;\n");
+    fprintf(cfh, "        if (nlit == 15) {\n");
+    fprintf(cfh, "            unsigned char b;\n");
+    fprintf(cfh, "            do {\n");
+    fprintf(cfh, "                if (src == end)\n");
+    fprintf(cfh, "                    return -1;\n");
+    fprintf(cfh, "                b = *src++;\n");
+    fprintf(cfh, "                nlit += b;\n");
+    fprintf(cfh, "            } while (b == 255);\n");
+    fprintf(cfh, "        }\n");
+    fprintf(cfh, "        if (nlit > (size_t)(end - src) || nlit > len - o)\n");
+    fprintf(cfh, "            return -1;\n");
+    fprintf(cfh, "        memcpy(dst + o, src, nlit);\n");
+    fprintf(cfh, "        src += nlit;\n");
+    fprintf(cfh, "        o += nlit;\n\n");
+    fprintf(cfh, "        // Only the last sequence has no match.\n");
+    fprintf(cfh, "        if (src == end)\n");
+    fprintf(cfh, "            break;\n");
+    fprintf(cfh, "        if (end - src < 2)\n");
+    fprintf(cfh, "            return -1;\n");
+    fprintf(cfh, "        size_t offset = src[0] | src[1] << 8;\n");
+    fprintf(cfh, "        src += 2;\n");
+    fprintf(cfh, "        if (offset == 0 || offset > o)\n");
+    fprintf(cfh, "            return -1;\n\n");
+    fprintf(cfh, "        size_t match = token & 15;\n");
+    fprintf(cfh, "        if (match == 15) {\n");
+    fprintf(cfh, "            unsigned char b;\n");
+    fprintf(cfh, "            do {\n");
+    fprintf(cfh, "                if (src == end)\n");
+    fprintf(cfh, "                    return -1;\n");
+    fprintf(cfh, "                b = *src++;\n");
+    fprintf(cfh, "                match += b;\n");
+    fprintf(cfh, "            } while (b == 255);\n");
+    fprintf(cfh, "        }\n");
+    fprintf(cfh, "        match += 4;\n");
+    fprintf(cfh, "        if (match > len - o)\n");
+    fprintf(cfh, "            return -1;\n\n");
+    fprintf(cfh, "        // A match may overlap the bytes it produces, repeating them.\n");
+    fprintf(cfh, "        if (match <= offset) {\n");
+    fprintf(cfh, "            memcpy(dst + o, dst + o - offset, match);\n");
+    fprintf(cfh, "            o += match;\n");
+    fprintf(cfh, "        } else {\n");
+    fprintf(cfh, "            for (size_t i = 0; i < match; i++, o++)\n");
+    fprintf(cfh, "                dst[o] = dst[o - offset];\n");
+    fprintf(cfh, "        }\n");
+    fprintf(cfh, "    }\n\n");
+    fprintf(cfh, "    return o == len ? 0 : -1;\n");
+    fprintf(cfh, "}\n\n");
+    fprintf(cfh, "/**\n");
+    fprintf(cfh, " * Creates a texture from the n bytes of the texture container at data, read\n");
+    fprintf(cfh, " * from path. Its header is 8 little-endian 32-bit words: magic, version,\n");
+    fprintf(cfh, " * width, height, pixel format, compression, payload size and a reserved word.\n");
+    fprintf(cfh, " */\n");
+    fprintf(cfh, "static SDL_Texture *\n");
+    fprintf(cfh, "%s_texture(SDL_Renderer *renderer, const char *path, const unsigned char *data, size_t n)\n", spec->name);
+    fprintf(cfh, "{\n");
+    fprintf(cfh, "    uint32_t header[8] = { 0 };\n");
+    fprintf(cfh, "    for (size_t i = 0; i < 32 && i < n; i++)\n");
+    fprintf(cfh, "        header[i / 4] |= (uint32_t)data[i] << 8 * (i %% 4);\n\n");
+    fprintf(cfh, "    size_t len = (size_t)header[2] * header[3] * 4;\n");
+    fprintf(cfh, "    const unsigned char *pixels = data + 32;\n");
+    fprintf(cfh, "    unsigned char *inflated = NULL;\n\n");
+    fprintf(cfh, "    int valid = n >= 32 && header[0] == %#xu && header[1] == %d && header[4] == %d\n", TEX_MAGIC, TEX_VERSION, TEX_RGBA8);
+    fprintf(cfh, "        && header[6] == n - 32;\n");
+    fprintf(cfh, "    // A block of LZ4 decompresses to at most 255 times its size, so any\n");
+    fprintf(cfh, "    // larger image can't be valid.\n");
+    fprintf(cfh, "    if (valid && header[5] == %d && len / 255 <= header[6]) {\n", TEX_LZ4);
+    fprintf(cfh, "        inflated = malloc(len + 1);\n");
+    fprintf(cfh, "        assert(inflated != NULL);\n");
+    fprintf(cfh, "        valid = %s_lz4(pixels, header[6], inflated, len) == 0;\n", spec->name);
+    fprintf(cfh, "        pixels = inflated;\n");
+    fprintf(cfh, "    } else if (header[5] != %d || header[6] != len) {\n", TEX_RAW);
+    fprintf(cfh, "        valid = 0;\n");
+    fprintf(cfh, "    }\n");
+    fprintf(cfh, "    if (!valid) {\n");
+    fprintf(cfh, "        fprintf(stderr, \"%s: %%s is not a valid texture\\n\", path);\n", spec->name);
+    fprintf(cfh, "        exit(1);\n");
+    fprintf(cfh, "    }\n\n");
+    fprintf(cfh, "    SDL_Texture *t = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, header[2], header[3]);\n");
+    fprintf(cfh, "    if (t == NULL || SDL_UpdateTexture(t, NULL, pixels, 4 * header[2])) {\n");
+    fprintf(cfh, "        fprintf(stderr, \"%s: failed to create texture of image %%s: %%s\\n\", path, SDL_GetError());\n", spec->name);
+    fprintf(cfh, "        exit(1);\n");
+    fprintf(cfh, "    }\n");
+    fprintf(cfh, "    SDL_SetTextureBlendMode(t, SDL_BLENDMODE_BLEND);\n\n");
+    fprintf(cfh, "    free(inflated);\n");
+    fprintf(cfh, "    return t;\n");
+    fprintf(cfh, "}\n\n");
+
+    if (spec->embed)
+        return;
+
+    fprintf(cfh, "/**\n");
+    fprintf(cfh, " * Loads the texture container at path, mapping it into memory rather than\n");
+    fprintf(cfh, " * reading it.\n");
+    fprintf(cfh, " */\n");
+    fprintf(cfh, "static SDL_Texture *\n");
+    fprintf(cfh, "%s_texture_file(SDL_Renderer *renderer, const char *path)\n", spec->name);
+    fprintf(cfh, "{\n");
+    fprintf(cfh, "    struct stat st;\n");
+    fprintf(cfh, "    int fd = open(path, O_RDONLY);\n");
+    fprintf(cfh, "    if (fd < 0 || fstat(fd, &st)) {\n");
+    fprintf(cfh, "        fprintf(stderr, \"%s: failed to open texture %%s: %%s\\n\", path, strerror(errno));\n", spec->name);
+    fprintf(cfh, "        exit(1);\n");
+    fprintf(cfh, "    }\n\n");
+    fprintf(cfh, "    const unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);\n");
+    fprintf(cfh, "    if (map == MAP_FAILED) {\n");
+    fprintf(cfh, "        fprintf(stderr, \"%s: failed to map texture %%s: %%s\\n\", path, strerror(errno));\n", spec->name);
+    fprintf(cfh, "        exit(1);\n");
+    fprintf(cfh, "    }\n");
+    fprintf(cfh, "    close(fd);\n\n");
+    fprintf(cfh, "    SDL_Texture *t = %s_texture(renderer, path, map, st.st_size);\n\n", spec->name);
+    fprintf(cfh, "    munmap((void *)map, st.st_size);\n");
+    fprintf(cfh, "    return t;\n");
+    fprintf(cfh, "}\n\n");
 }
 
 bool
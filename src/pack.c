@@ -0,0 +1,645 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+
+#include "queue.h"
+#include "arena.h"
+#include "frontier.h"
+#include "grid.h"
+#include "pack.h"
+
+bool
+posn_cmp(const void *a, const void *b)
+{
+    const struct posn *i = a;
+    const struct posn *j = b;
+
+    unsigned mi = i->x > i->y ? i->x : i->y;
+    unsigned mj = j->x > j->y ? j->x : j->y;
+
+    if (mi == mj) {
+        if (i->x < j->x || i->y < j->y)
+            return true;
+        else
+            return false;
+    }
+
+    return mi < mj;
+}
+
+const char *
+engine_name(enum engine engine)
+{
+    switch (engine) {
+    case ENGINE_FRONTIER: return "frontier";
+    case ENGINE_SKYLINE: return "skyline";
+    case ENGINE_MAXRECTS: return "maxrects";
+    }
+    return "?";
+}
+
+const char *
+rule_name(enum rule rule)
+{
+    switch (rule) {
+    case RULE_BOTTOM_LEFT: return "bl";
+    case RULE_MIN_WASTE: return "waste";
+    case RULE_SHORT_SIDE: return "bssf";
+    case RULE_LONG_SIDE: return "blsf";
+    case RULE_AREA: return "baf";
+    case RULE_CONTACT: return "contact";
+    }
+    return "?";
+}
+
+void
+pack(const struct packopts *opts, const struct box *boxes, unsigned n, struct posn *at,
+        struct packstats *stats)
+{
+    switch (opts->engine) {
+    case ENGINE_FRONTIER:
+        pack_frontier(boxes, n, opts->indexed, at, stats);
+        break;
+    case ENGINE_SKYLINE:
+        pack_skyline(boxes, n, opts->rule, at);
+        break;
+    case ENGINE_MAXRECTS:
+        pack_maxrects(boxes, n, opts->rule, at);
+        break;
+    }
+}
+
+/**
+ * A [posnq] is a node of the queue of positions to retry in [pack_frontier].
+ */
+SIMPLEQ_HEAD(posnqhd, posnq);
+struct posnq {
+    struct posn v;
+    SIMPLEQ_ENTRY(posnq) entries;
+};
+
+/**
+ * [POSNQS_PER_CHUNK] is the number of [posnq]s allocated at a time by
+ * [pack_frontier].
+ */
+#define POSNQS_PER_CHUNK 1024
+
+void
+pack_frontier(const struct box *boxes, unsigned n, bool indexed, struct posn *at,
+        struct packstats *stats)
+{
+    // [grid] will record which positions in the packed image already contain
+    // an image (or a part of one). The minimum position unit is a square of
+    // pixels of side length [spec->unit].
+    struct grid *grid = grid_alloc();
+    assert(grid != NULL);
+
+    if (indexed) {
+        grid_index(grid);
+    }
+
+    // [frontier] is a min-heap w.r.t. position coordinates which we will use
+    // to get the position we should next try to place an input image at.
+    // Each image placed adds two positions and takes at least one away, so
+    // it never holds more than 2n + 1 and never needs to grow.
+    struct frontier frontier;
+    frontier_init(&frontier);
+    frontier_reserve(&frontier, 2 * (size_t)n + 1);
+
+    // Every failed attempt queues its position for a retry, which on large
+    // inputs makes these by far the most common allocations. [posnqs] hands
+    // them out in bulk and recycles them; everything is freed at the end.
+    struct arena posnqs;
+    arena_init(&posnqs, sizeof(struct posnq), POSNQS_PER_CHUNK);
+
+    // [start] is the top-left corner, where we will try to place the first image.
+    struct posn start = { 0, 0 };
+
+    frontier_push(&frontier, start);
+
+    // [pops], [rejected] and [resizes] are counted for [stats].
+    unsigned long pops = 0;
+    unsigned long rejected = 0;
+    unsigned long resizes = 0;
+
+    // Pack all of the input images.
+    // For an overview of the heuristic, see the README.
+    for (unsigned i = 0; i < n; i++) {
+        unsigned wu = boxes[i].w;
+        unsigned hu = boxes[i].h;
+
+        // [posnqhd] will point to a queue of positions we have tried to insert
+        // the current image at but which didn't work, due to not enough space
+        // being available. At the end of the attempting-to-place loop, we add
+        // these back to the heap.
+        struct posnqhd posnqhd = SIMPLEQ_HEAD_INITIALIZER(posnqhd);
+
+        // Loop while we try to find somewhere to put this input.
+        for (;;) {
+            if (frontier.len == 0) {
+                // This should not be possible (means we've somehow ran out of
+                // places to try placing images at.
+                assert(false);
+            }
+
+            // [top] is the position we will try to place this input image at.
+            struct posn top = frontier_pop(&frontier);
+            pops++;
+
+            // If the position has been filled by someone, there's no use
+            // keeping it in the heap.
+            if (grid_marked(grid, top.x, top.y)) {
+                continue;
+            }
+
+            // Check to make sure there is enough space available at this
+            // position to place the image.
+            bool failed = !grid_vacant(grid, top.x, top.y, wu, hu);
+
+            // If we failed, add this position to the queue of positions to add
+            // back to the heap after we're done.  We don't want to add it back
+            // immediately, obviously, because then we'd end up in an infinite
+            // loop...
+            if (failed) {
+                rejected++;
+                struct posnq *posnq = arena_get(&posnqs);
+                posnq->v = top;
+                SIMPLEQ_INSERT_TAIL(&posnqhd, posnq, entries);
+                continue;
+            }
+
+            // We haven't failed--mark the positions now occupied by the input
+            // image!
+            if (grid_fill(grid, top.x, top.y, wu, hu))
+                resizes++;
+
+            at[i] = top;
+
+            // [a] and [b] are the new positions for subsequent images to try.
+            // One is at the north-east corner of this image, and the other is
+            // at the southwest corner.
+            struct posn a = { top.x + wu, top.y };
+            struct posn b = { top.x, top.y + hu };
+
+            frontier_push(&frontier, a);
+            frontier_push(&frontier, b);
+
+            break;
+        }
+
+        // Add the positions that didn't have space for the image back to the
+        // queue, because they might work for a smaller image.
+        struct posnq *posnq, *tposnq;
+        SIMPLEQ_FOREACH_SAFE(posnq, &posnqhd, entries, tposnq) {
+            frontier_push(&frontier, posnq->v);
+            arena_put(&posnqs, posnq);
+        }
+    }
+
+    if (stats != NULL) {
+        stats->objects += frontier.pushes + posnqs.gets;
+        stats->allocs += frontier.allocs + posnqs.allocs;
+        stats->pops += pops;
+        stats->rejected += rejected;
+        stats->resizes += resizes;
+        if (frontier.peak > stats->peak)
+            stats->peak = frontier.peak;
+    }
+
+    arena_free(&posnqs);
+    frontier_free(&frontier);
+    grid_free(grid);
+}
+
+/**
+ * [pack_width boxes n] returns the width of a roughly square bin that can hold
+ * the [n] [boxes]: the side of a square with their total area, but at least
+ * as wide as the widest box.
+ */
+static unsigned
+pack_width(const struct box *boxes, unsigned n)
+{
+    double area = 0;
+    unsigned widest = 1;
+
+    for (unsigned i = 0; i < n; i++) {
+        area += (double)boxes[i].w * boxes[i].h;
+        if (boxes[i].w > widest)
+            widest = boxes[i].w;
+    }
+
+    unsigned w = ceil(sqrt(area));
+    return w > widest ? w : widest;
+}
+
+/**
+ * A [segment] is a horizontal piece of the skyline: the top of everything
+ * placed in the columns [x, x + w) is at [y].
+ */
+struct segment {
+    unsigned x;
+    unsigned y;
+    unsigned w;
+};
+
+/**
+ * [skyline_fit sky len i w width y waste] checks whether a box [w] wide can be
+ * placed with its left edge at the start of segment [i] of the skyline [sky],
+ * which has [len] segments and spans [width] columns. If so, it stores the
+ * lowest such [y] and the area left empty below the box into [y] and [waste]
+ * and returns [true].
+ */
+static bool
+skyline_fit(const struct segment *sky, unsigned len, unsigned i, unsigned w, unsigned width,
+        unsigned *y, double *waste)
+{
+    unsigned x = sky[i].x;
+    if (x + w > width)
+        return false;
+
+    // The box rests on the highest segment below it.
+    unsigned top = 0;
+    for (unsigned j = i; j < len && sky[j].x < x + w; j++) {
+        if (sky[j].y > top)
+            top = sky[j].y;
+    }
+
+    double empty = 0;
+    for (unsigned j = i; j < len && sky[j].x < x + w; j++) {
+        unsigned right = sky[j].x + sky[j].w < x + w ? sky[j].x + sky[j].w : x + w;
+        empty += (double)(top - sky[j].y) * (right - sky[j].x);
+    }
+
+    *y = top;
+    *waste = empty;
+    return true;
+}
+
+void
+pack_skyline(const struct box *boxes, unsigned n, enum rule rule, struct posn *at)
+{
+    unsigned width = pack_width(boxes, n);
+
+    // [sky] holds the skyline's segments from left to right. Placing a box adds
+    // at most one segment, so [n + 1] is always enough room.
+    struct segment *sky = malloc((n + 1) * sizeof(struct segment));
+    assert(sky != NULL);
+
+    unsigned len = 1;
+    sky[0].x = 0;
+    sky[0].y = 0;
+    sky[0].w = width;
+
+    // [height] is the height of the tallest point of the skyline.
+    unsigned height = 0;
+
+    for (unsigned k = 0; k < n; k++) {
+        unsigned w = boxes[k].w;
+        unsigned h = boxes[k].h;
+
+        // Find the best segment to put the box's left edge on.
+        bool found = false;
+        unsigned best = 0, besty = 0;
+        double bestwaste = 0;
+
+        for (unsigned i = 0; i < len; i++) {
+            unsigned y;
+            double waste;
+            if (!skyline_fit(sky, len, i, w, width, &y, &waste))
+                continue;
+
+            // Under the min-waste rule, positions that don't make the packing
+            // any taller come first; without that, a snug spot high up always
+            // beats a slightly wasteful one near the bottom and the packing
+            // degenerates into a tower.
+            bool better;
+            if (!found)
+                better = true;
+            else if (rule == RULE_MIN_WASTE && (y + h > height) != (besty + h > height))
+                better = y + h <= height;
+            else if (rule == RULE_MIN_WASTE && waste != bestwaste)
+                better = waste < bestwaste;
+            else
+                better = y < besty;
+
+            if (better) {
+                found = true;
+                best = i;
+                besty = y;
+                bestwaste = waste;
+            }
+        }
+
+        // The skyline is at least as wide as the widest box, and the first
+        // segment always starts at 0, so there is always somewhere to go.
+        assert(found);
+
+        at[k].x = sky[best].x;
+        at[k].y = besty;
+
+        if (besty + h > height)
+            height = besty + h;
+
+        // Cut the columns the box covers out of the segments it rests on...
+        unsigned x = sky[best].x;
+        unsigned j = best;
+        while (j < len && sky[j].x < x + w) {
+            unsigned right = sky[j].x + sky[j].w;
+            if (right <= x + w) {
+                j++;
+                continue;
+            }
+            sky[j].w = right - (x + w);
+            sky[j].x = x + w;
+            break;
+        }
+
+        // ...and replace the ones it covers completely with a new segment on
+        // top of the box.
+        struct segment seg = { x, besty + h, w };
+        memmove(&sky[best + 1], &sky[j], (len - j) * sizeof(struct segment));
+        len = len - (j - best) + 1;
+        sky[best] = seg;
+
+        // Merge the new segment with its neighbours if they're at the same
+        // height, to keep the skyline short.
+        if (best + 1 < len && sky[best + 1].y == seg.y) {
+            sky[best].w += sky[best + 1].w;
+            memmove(&sky[best + 1], &sky[best + 2], (len - best - 2) * sizeof(struct segment));
+            len--;
+        }
+        if (best > 0 && sky[best - 1].y == seg.y) {
+            sky[best - 1].w += sky[best].w;
+            memmove(&sky[best], &sky[best + 1], (len - best - 1) * sizeof(struct segment));
+            len--;
+        }
+    }
+
+    free(sky);
+}
+
+/**
+ * A [rect] is a rectangle of pixel squares with its top-left corner at
+ * (x, y).
+ */
+struct rect {
+    unsigned x;
+    unsigned y;
+    unsigned w;
+    unsigned h;
+};
+
+/**
+ * [rects] is a growable flat array of [rect]s. Keeping the free list in one
+ * array rather than a linked list makes the scans over it, which are most of
+ * the work of the MaxRects engine, sequential in memory.
+ */
+struct rects {
+    struct rect *v;
+    unsigned len;
+    unsigned cap;
+};
+
+static void
+rects_push(struct rects *rs, struct rect r)
+{
+    if (rs->len == rs->cap) {
+        rs->cap = rs->cap ? rs->cap * 2 : 64;
+        rs->v = realloc(rs->v, rs->cap * sizeof(struct rect));
+        assert(rs->v != NULL);
+    }
+    rs->v[rs->len++] = r;
+}
+
+static inline bool
+rect_contains(const struct rect *a, const struct rect *b)
+{
+    return b->x >= a->x && b->y >= a->y
+        && b->x + b->w <= a->x + a->w && b->y + b->h <= a->y + a->h;
+}
+
+static inline bool
+rect_intersects(const struct rect *a, const struct rect *b)
+{
+    return a->x < b->x + b->w && b->x < a->x + a->w
+        && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+/**
+ * [span_overlap a0 a1 b0 b1] returns the length of the overlap of the spans
+ * [a0, a1) and [b0, b1).
+ */
+static inline unsigned
+span_overlap(unsigned a0, unsigned a1, unsigned b0, unsigned b1)
+{
+    unsigned lo = a0 > b0 ? a0 : b0;
+    unsigned hi = a1 < b1 ? a1 : b1;
+    return hi > lo ? hi - lo : 0;
+}
+
+/**
+ * [maxrects_contact used side r] returns the length of the edges of [r] that
+ * touch the edges of the bin, which is [side] squares square, or of the
+ * rectangles in [used].
+ */
+static unsigned
+maxrects_contact(const struct rects *used, unsigned side, const struct rect *r)
+{
+    unsigned score = 0;
+
+    if (r->x == 0 || r->x + r->w == side)
+        score += r->h;
+    if (r->y == 0 || r->y + r->h == side)
+        score += r->w;
+
+    for (unsigned i = 0; i < used->len; i++) {
+        const struct rect *u = &used->v[i];
+        if (u->x == r->x + r->w || u->x + u->w == r->x)
+            score += span_overlap(u->y, u->y + u->h, r->y, r->y + r->h);
+        if (u->y == r->y + r->h || u->y + u->h == r->y)
+            score += span_overlap(u->x, u->x + u->w, r->x, r->x + r->w);
+    }
+
+    return score;
+}
+
+/**
+ * [maxrects_split avail used] removes the space taken by [used] from the free
+ * rectangles in [avail], replacing each free rectangle it overlaps with the
+ * (up to four) maximal rectangles left around it, and then prunes any free
+ * rectangle contained in another.
+ */
+static void
+maxrects_split(struct rects *avail, const struct rect *used)
+{
+    unsigned old = avail->len;
+    unsigned kept = 0;
+
+    // Split the free rectangles that [used] overlaps. Survivors are compacted
+    // towards the front; the new pieces are appended after [old].
+    for (unsigned i = 0; i < old; i++) {
+        struct rect f = avail->v[i];
+
+        if (!rect_intersects(&f, used)) {
+            avail->v[kept++] = f;
+            continue;
+        }
+
+        if (used->x > f.x) {
+            struct rect r = { f.x, f.y, used->x - f.x, f.h };
+            rects_push(avail, r);
+        }
+        if (used->x + used->w < f.x + f.w) {
+            struct rect r = { used->x + used->w, f.y, f.x + f.w - (used->x + used->w), f.h };
+            rects_push(avail, r);
+        }
+        if (used->y > f.y) {
+            struct rect r = { f.x, f.y, f.w, used->y - f.y };
+            rects_push(avail, r);
+        }
+        if (used->y + used->h < f.y + f.h) {
+            struct rect r = { f.x, used->y + used->h, f.w, f.y + f.h - (used->y + used->h) };
+            rects_push(avail, r);
+        }
+    }
+
+    // Move the new pieces down next to the survivors.
+    unsigned added = avail->len - old;
+    memmove(&avail->v[kept], &avail->v[old], added * sizeof(struct rect));
+    avail->len = kept + added;
+
+    // The survivors were already pruned against each other, so only pairs
+    // involving a new piece need checking. [dead] marks pruned rectangles
+    // until the array is compacted at the end.
+    bool *dead = calloc(avail->len + 1, sizeof(bool));
+    assert(dead != NULL);
+
+    for (unsigned i = kept; i < avail->len; i++) {
+        for (unsigned j = 0; j < avail->len && !dead[i]; j++) {
+            if (i == j || dead[j])
+                continue;
+            if (rect_contains(&avail->v[j], &avail->v[i]))
+                dead[i] = true;
+            else if (j < kept && rect_contains(&avail->v[i], &avail->v[j]))
+                dead[j] = true;
+        }
+    }
+
+    unsigned len = 0;
+    for (unsigned i = 0; i < avail->len; i++) {
+        if (!dead[i])
+            avail->v[len++] = avail->v[i];
+    }
+    avail->len = len;
+
+    free(dead);
+}
+
+/**
+ * [maxrects_try boxes n rule side at] tries to place the [n] [boxes] into a
+ * [side] × [side] bin. Returns [false] if one of them doesn't fit.
+ */
+static bool
+maxrects_try(const struct box *boxes, unsigned n, enum rule rule, unsigned side, struct posn *at)
+{
+    struct rects avail = { NULL, 0, 0 };
+    struct rects used = { NULL, 0, 0 };
+
+    struct rect bin = { 0, 0, side, side };
+    rects_push(&avail, bin);
+
+    bool fits = true;
+
+    for (unsigned k = 0; k < n && fits; k++) {
+        unsigned w = boxes[k].w;
+        unsigned h = boxes[k].h;
+
+        // Score every free rectangle the box fits in; lower is better. Each
+        // rule has a primary and a secondary score.
+        bool found = false;
+        struct rect best = { 0, 0, w, h };
+        unsigned long long best1 = 0, best2 = 0;
+
+        for (unsigned i = 0; i < avail.len; i++) {
+            const struct rect *f = &avail.v[i];
+            if (f->w < w || f->h < h)
+                continue;
+
+            unsigned lw = f->w - w;
+            unsigned lh = f->h - h;
+            unsigned short_side = lw < lh ? lw : lh;
+            unsigned long_side = lw > lh ? lw : lh;
+            struct rect r = { f->x, f->y, w, h };
+
+            unsigned long long s1, s2;
+            switch (rule) {
+            case RULE_LONG_SIDE:
+                s1 = long_side;
+                s2 = short_side;
+                break;
+            case RULE_AREA:
+                s1 = (unsigned long long)f->w * f->h - (unsigned long long)w * h;
+                s2 = short_side;
+                break;
+            case RULE_BOTTOM_LEFT:
+                s1 = f->y + h;
+                s2 = f->x;
+                break;
+            case RULE_CONTACT:
+                // Contact is better when larger, so count down from the
+                // largest possible score.
+                s1 = 2ULL * (w + h) - maxrects_contact(&used, side, &r);
+                s2 = f->y + h;
+                break;
+            case RULE_SHORT_SIDE:
+            default:
+                s1 = short_side;
+                s2 = long_side;
+                break;
+            }
+
+            if (!found || s1 < best1 || (s1 == best1 && s2 < best2)) {
+                found = true;
+                best = r;
+                best1 = s1;
+                best2 = s2;
+            }
+        }
+
+        if (!found) {
+            fits = false;
+            break;
+        }
+
+        at[k].x = best.x;
+        at[k].y = best.y;
+
+        maxrects_split(&avail, &best);
+        if (rule == RULE_CONTACT)
+            rects_push(&used, best);
+    }
+
+    free(avail.v);
+    free(used.v);
+
+    return fits;
+}
+
+void
+pack_maxrects(const struct box *boxes, unsigned n, enum rule rule, struct posn *at)
+{
+    // Start with a square bin just big enough for the inputs' area, and grow
+    // it a little at a time until everything fits.
+    unsigned side = pack_width(boxes, n);
+    for (unsigned i = 0; i < n; i++) {
+        if (boxes[i].h > side)
+            side = boxes[i].h;
+    }
+
+    while (!maxrects_try(boxes, n, rule, side, at)) {
+        side += side / 32 > 0 ? side / 32 : 1;
+    }
+}
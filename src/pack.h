@@ -0,0 +1,102 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A [posn] represents a coordinate (x, y).
+ * We use it to represent the pixel square with coordinates (x, y), which means
+ * that to get the position of the pixel square in pixels you need to multiply
+ * by [spec->unit].
+ */
+struct posn {
+    unsigned x;
+    unsigned y;
+};
+
+/**
+ * A [box] is the size of an image to be packed, in pixel squares.
+ */
+struct box {
+    unsigned w;
+    unsigned h;
+};
+
+/**
+ * An [engine] is a packing algorithm. See the README for descriptions.
+ */
+enum engine {
+    ENGINE_FRONTIER, //!< The original greedy heuristic, placing images at the free corner closest to the origin.
+    ENGINE_SKYLINE, //!< Images are stacked on top of a skyline spanning a fixed width.
+    ENGINE_MAXRECTS, //!< Images are placed in the maximal free rectangles of a fixed-size bin.
+};
+
+/**
+ * A [rule] chooses between candidate positions in engines that support more
+ * than one way of doing so.
+ */
+enum rule {
+    RULE_BOTTOM_LEFT, //!< Prefer the position whose far edge is closest to the origin.
+    RULE_MIN_WASTE, //!< Prefer the position that leaves the least unusable space behind.
+    RULE_SHORT_SIDE, //!< Prefer the free rectangle whose shorter leftover side is smallest.
+    RULE_LONG_SIDE, //!< Prefer the free rectangle whose longer leftover side is smallest.
+    RULE_AREA, //!< Prefer the free rectangle with the least leftover area.
+    RULE_CONTACT, //!< Prefer the position touching the most edges of placed images and the bin.
+};
+
+/**
+ * A [packopts] structure selects and configures a packing engine.
+ */
+struct packopts {
+    enum engine engine;
+    enum rule rule;
+    bool indexed; //!< [indexed] is set if the frontier engine's grid should keep an occupancy index. See grid.h.
+};
+
+/**
+ * A [packstats] structure collects statistics about a packing for [-v] and
+ * --stats. Only the frontier engine collects any.
+ */
+struct packstats {
+    unsigned long objects; //!< [objects] is the number of frontier positions and retry queue nodes handed out.
+    unsigned long allocs; //!< [allocs] is the number of allocations made to hold them.
+    unsigned long pops; //!< [pops] is the number of positions taken off the frontier.
+    unsigned long rejected; //!< [rejected] is the number of those where the box didn't fit.
+    unsigned long resizes; //!< [resizes] is the number of times the grid had to grow.
+    size_t peak; //!< [peak] is the most positions the frontier held at once.
+};
+
+/**
+ * [posn_cmp] returns [true] if the coordinates of the [posn] [a] is
+ * less than the coordinates for [b] and false otherwise.
+ * First the maximums of the x and y values are compared; if equality occurs,
+ * then the individual components are compared.
+ * It is intended for use with [heap]. Note that it isn't a strict ordering
+ * when the maximums are equal; the frontier engine uses the strict ordering
+ * of [frontier] instead.
+ */
+bool posn_cmp(const void *a, const void *b);
+
+/**
+ * [pack opts boxes n at stats] places the [n] [boxes] in order using the
+ * engine selected by [opts], storing the position of [boxes[i]] into [at[i]].
+ * Placed boxes never overlap. If [stats] isn't null, statistics about the
+ * packing are added to it.
+ */
+void pack(const struct packopts *opts, const struct box *boxes, unsigned n, struct posn *at,
+        struct packstats *stats);
+
+/**
+ * [engine_name engine] and [rule_name rule] return the names used for
+ * [engine] and [rule] in the packer directive.
+ */
+const char *engine_name(enum engine engine);
+const char *rule_name(enum rule rule);
+
+void pack_frontier(const struct box *boxes, unsigned n, bool indexed, struct posn *at,
+        struct packstats *stats);
+void pack_skyline(const struct box *boxes, unsigned n, enum rule rule, struct posn *at);
+void pack_maxrects(const struct box *boxes, unsigned n, enum rule rule, struct posn *at);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include "phash.h"
+
+/**
+ * [MAX_SEEDS] is how many seeds are tried before giving up, and [MAX_DISP]
+ * how many displacements are tried for a bucket before trying the next seed.
+ * Either limit is only ever reached when keys collide, which 64-bit hashes of
+ * distinct keys practically never do.
+ */
+#define MAX_SEEDS 16
+#define MAX_DISP (1 << 20)
+
+uint64_t
+phash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint64_t
+phash_key(const char *key, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (; *key; key++)
+        h = (h ^ (unsigned char)*key) * 0x100000001b3ULL;
+    return phash_mix(h);
+}
+
+unsigned
+phash_slot(uint64_t h, int32_t d, unsigned n)
+{
+    return phash_mix(h + (uint64_t)d * 0x9e3779b97f4a7c15ULL) % n;
+}
+
+/**
+ * [attempt ph keys n seed] tries to build [ph] from [keys] hashed with
+ * [seed]. Returns 1 on success, 0 if another seed should be tried and -1
+ * (after printing an error) if two keys are the same.
+ */
+static int
+attempt(struct phash *ph, const char *const *keys, unsigned n, uint64_t seed)
+{
+    int result = 0;
+
+    uint64_t *hashes = malloc(n * sizeof(uint64_t) + 1);
+    assert(hashes != NULL);
+    // The keys of bucket b are members[start[b]] to members[start[b + 1] - 1].
+    unsigned *start = calloc(n + 1, sizeof(unsigned));
+    assert(start != NULL);
+    unsigned *members = malloc(n * sizeof(unsigned) + 1);
+    assert(members != NULL);
+    // [order] lists the buckets from the largest to the smallest, so the
+    // hardest ones are placed while most slots are free.
+    unsigned *order = malloc(n * sizeof(unsigned) + 1);
+    assert(order != NULL);
+    unsigned *count = calloc(n + 1, sizeof(unsigned));
+    assert(count != NULL);
+    unsigned *placing = malloc(n * sizeof(unsigned) + 1);
+    assert(placing != NULL);
+    unsigned char *taken = calloc(n, 1);
+    assert(taken != NULL);
+
+    for (unsigned i = 0; i < n; i++) {
+        hashes[i] = phash_key(keys[i], seed);
+        start[hashes[i] % n]++;
+    }
+    // Turn the sizes into ends, and then fill each bucket from its end.
+    for (unsigned b = 1; b <= n; b++)
+        start[b] += start[b - 1];
+    for (unsigned i = n; i-- > 0;)
+        members[--start[hashes[i] % n]] = i;
+
+    for (unsigned b = 0; b < n; b++)
+        count[start[b + 1] - start[b]]++;
+    for (unsigned size = n; size-- > 0;)
+        count[size] += count[size + 1];
+    for (unsigned b = n; b-- > 0;)
+        order[--count[start[b + 1] - start[b]]] = b;
+
+    unsigned o = 0;
+    for (; o < n; o++) {
+        unsigned b = order[o];
+        unsigned size = start[b + 1] - start[b];
+        unsigned *bucket = members + start[b];
+        if (size < 2)
+            break;
+
+        // Keys with the same hash can't be told apart by any displacement.
+        for (unsigned k = 0; k < size; k++) {
+            for (unsigned l = k + 1; l < size; l++) {
+                if (hashes[bucket[k]] != hashes[bucket[l]])
+                    continue;
+                if (!strcmp(keys[bucket[k]], keys[bucket[l]])) {
+                    fprintf(stderr, "phash_build: '%s' is given more than once\n", keys[bucket[k]]);
+                    result = -1;
+                }
+                goto close;
+            }
+        }
+
+        int32_t d = 1;
+        for (;; d++) {
+            if (d > MAX_DISP)
+                goto close;
+
+            unsigned k = 0;
+            for (; k < size; k++) {
+                unsigned slot = phash_slot(hashes[bucket[k]], d, n);
+                if (taken[slot])
+                    break;
+                taken[slot] = 1;
+                placing[k] = slot;
+            }
+            if (k == size)
+                break;
+            while (k-- > 0)
+                taken[placing[k]] = 0;
+        }
+
+        ph->disp[b] = d;
+        for (unsigned k = 0; k < size; k++)
+            ph->slots[placing[k]] = bucket[k];
+    }
+
+    // The buckets of single keys point straight at the remaining slots, and
+    // the empty buckets are left at 0.
+    unsigned slot = 0;
+    for (; o < n; o++) {
+        unsigned b = order[o];
+        if (start[b + 1] == start[b]) {
+            ph->disp[b] = 0;
+            continue;
+        }
+        while (taken[slot])
+            slot++;
+        taken[slot] = 1;
+        ph->disp[b] = -(int32_t)slot - 1;
+        ph->slots[slot] = members[start[b]];
+    }
+
+    ph->seed = seed;
+    result = 1;
+
+close:
+    free(hashes);
+    free(start);
+    free(members);
+    free(order);
+    free(count);
+    free(placing);
+    free(taken);
+    return result;
+}
+
+bool
+phash_build(struct phash *ph, const char *const *keys, unsigned n)
+{
+    assert(n <= INT32_MAX);
+
+    ph->n = n;
+    ph->seed = 0;
+    ph->disp = malloc(n * sizeof(int32_t) + 1);
+    assert(ph->disp != NULL);
+    ph->slots = malloc(n * sizeof(unsigned) + 1);
+    assert(ph->slots != NULL);
+
+    if (n == 0)
+        return true;
+
+    for (uint64_t seed = 0; seed < MAX_SEEDS; seed++) {
+        int result = attempt(ph, keys, n, seed);
+        if (result > 0)
+            return true;
+        if (result < 0)
+            return false;
+    }
+
+    fprintf(stderr, "phash_build: failed to find a perfect hash of %u keys\n", n);
+    return false;
+}
+
+void
+phash_free(struct phash *ph)
+{
+    free(ph->disp);
+    free(ph->slots);
+}
@@ -0,0 +1,58 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A [phash] is a minimal perfect hash function over [n] distinct strings: it
+ * maps each of them to its own slot in [0, n). It is built by hashing and
+ * displacing, after Steve Hanov's "Throw away the keys":
+ * http://stevehanov.ca/blog/?id=119. The slot of [key] is found with
+ *
+ *     uint64_t h = phash_key(key, seed);
+ *     int32_t d = disp[h % n];
+ *     unsigned slot = d < 0 ? -d - 1 : phash_slot(h, d, n);
+ *
+ * which generated code repeats word for word. Strings that aren't among the
+ * [n] also get a slot, so the string at a slot must be compared to [key] to
+ * tell them apart.
+ */
+struct phash {
+    unsigned n;
+    uint64_t seed; //!< [seed] is the seed of [phash_key] that made the hash perfect.
+    int32_t *disp; //!< [disp] holds the displacement of each of the [n] buckets of keys.
+    unsigned *slots; //!< [slots] holds the index of the key in each of the [n] slots.
+};
+
+/**
+ * [phash_build ph keys n] builds the minimal perfect hash of the [n] [keys]
+ * into [ph], in time linear in [n]. Returns [false] (after printing an
+ * error) if the [keys] aren't distinct.
+ */
+bool phash_build(struct phash *ph, const char *const *keys, unsigned n);
+
+/**
+ * [phash_free ph] frees the tables of [ph], but not [ph] itself.
+ */
+void phash_free(struct phash *ph);
+
+/**
+ * [phash_mix x] returns [x] with its bits mixed, by the finalizer of
+ * MurmurHash3's 64-bit hash.
+ */
+uint64_t phash_mix(uint64_t x);
+
+/**
+ * [phash_key key seed] returns the [phash_mix]ed 64-bit FNV-1a hash of the
+ * string [key], starting from FNV's offset basis xor [seed].
+ */
+uint64_t phash_key(const char *key, uint64_t seed);
+
+/**
+ * [phash_slot h d n] returns the slot in [0, n) of the key hashing to [h],
+ * in a bucket with the displacement [d].
+ */
+unsigned phash_slot(uint64_t h, int32_t d, unsigned n);
+
+#endif
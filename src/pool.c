@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/**
+ * A [task] is a queued call waiting for a thread to run it.
+ */
+struct task {
+    pool_task_func_t fn;
+    void *arg;
+    struct pool_group *group;
+    struct task *next;
+};
+
+struct pool {
+    unsigned jobs; //!< [jobs] is the number of tasks that can run at once.
+    pthread_t *threads; //!< [threads] are the [jobs - 1] workers.
+
+    pthread_mutex_t lock; //!< [lock] protects everything below, and the [pending] counts of groups.
+    pthread_cond_t queued; //!< [queued] is signalled when a task is queued or the pool is stopping.
+    pthread_cond_t finished; //!< [finished] is broadcast whenever a task finishes.
+
+    struct task *head; //!< [head] is the next task to run.
+    struct task *tail; //!< [tail] is the most recently queued task.
+    bool stopping; //!< [stopping] is set by [pool_free] to make the workers exit.
+};
+
+/**
+ * [pool_run pool] takes the task at the head of [pool]'s queue and runs it.
+ * [pool->lock] must be held and the queue must be non-empty. The lock is
+ * released while the task runs.
+ */
+static void
+pool_run(struct pool *pool)
+{
+    struct task *task = pool->head;
+    pool->head = task->next;
+    if (pool->head == NULL)
+        pool->tail = NULL;
+
+    pthread_mutex_unlock(&pool->lock);
+    task->fn(task->arg);
+    pthread_mutex_lock(&pool->lock);
+
+    task->group->pending--;
+    pthread_cond_broadcast(&pool->finished);
+    free(task);
+}
+
+static void *
+pool_worker(void *arg)
+{
+    struct pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->head == NULL && !pool->stopping)
+            pthread_cond_wait(&pool->queued, &pool->lock);
+
+        if (pool->head == NULL)
+            break;
+
+        pool_run(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+struct pool *
+pool_alloc(unsigned jobs)
+{
+    assert(jobs > 0);
+
+    struct pool *pool = malloc(sizeof(struct pool));
+    if (pool == NULL) return NULL;
+
+    pool->jobs = jobs;
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->stopping = false;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    pool->threads = malloc((jobs - 1) * sizeof(pthread_t) + 1);
+    assert(pool->threads != NULL);
+
+    for (unsigned i = 0; i < jobs - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool)) {
+            // Running with fewer workers is slower, but still correct.
+            pool->jobs = i + 1;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+void
+pool_free(struct pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->jobs - 1; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->queued);
+    pthread_cond_destroy(&pool->finished);
+
+    free(pool->threads);
+    free(pool);
+}
+
+unsigned
+pool_jobs(const struct pool *pool)
+{
+    return pool->jobs;
+}
+
+void
+pool_submit(struct pool *pool, struct pool_group *group, pool_task_func_t fn, void *arg)
+{
+    struct task *task = malloc(sizeof(struct task));
+    assert(task != NULL);
+
+    task->fn = fn;
+    task->arg = arg;
+    task->group = group;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL)
+        pool->head = task;
+    else
+        pool->tail->next = task;
+    pool->tail = task;
+    group->pending++;
+    pthread_cond_signal(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+pool_wait(struct pool *pool, struct pool_group *group)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (group->pending > 0) {
+        // Rather than sleeping, help out with whatever is queued. This also
+        // keeps tasks that wait on other tasks from deadlocking the pool.
+        if (pool->head != NULL)
+            pool_run(pool);
+        else
+            pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * A [forctx] is shared between the tasks started by [pool_for]; each one
+ * claims indices from [next] until there are none left.
+ */
+struct forctx {
+    pthread_mutex_t lock;
+    unsigned next;
+    unsigned n;
+    void (*fn)(void *ctx, unsigned i);
+    void *ctx;
+};
+
+static void
+pool_for_task(void *arg)
+{
+    struct forctx *fc = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&fc->lock);
+        unsigned i = fc->next++;
+        pthread_mutex_unlock(&fc->lock);
+
+        if (i >= fc->n)
+            break;
+
+        fc->fn(fc->ctx, i);
+    }
+}
+
+void
+pool_for(struct pool *pool, unsigned n, void (*fn)(void *ctx, unsigned i), void *ctx)
+{
+    struct forctx fc = { .next = 0, .n = n, .fn = fn, .ctx = ctx };
+    pthread_mutex_init(&fc.lock, NULL);
+
+    struct pool_group group = POOL_GROUP_INIT;
+    unsigned tasks = n < pool->jobs ? n : pool->jobs;
+    for (unsigned i = 0; i < tasks; i++) {
+        pool_submit(pool, &group, pool_for_task, &fc);
+    }
+    pool_wait(pool, &group);
+
+    pthread_mutex_destroy(&fc.lock);
+}
+
+unsigned
+ncpus()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
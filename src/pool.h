@@ -0,0 +1,66 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+
+/**
+ * A [pool] is a fixed set of worker threads that run tasks submitted with
+ * [pool_submit]. Tasks are grouped with a [pool_group] so that a caller can
+ * wait for just the tasks it submitted with [pool_wait].
+ * The thread calling [pool_wait] runs queued tasks itself while it waits, so a
+ * pool created for [n] jobs starts [n - 1] workers, and a pool created for one
+ * job runs every task on the calling thread.
+ * Pools are created using [pool_alloc] and freed with [pool_free].
+ */
+struct pool;
+
+/**
+ * A [pool_group] counts the tasks submitted against it that have not finished
+ * yet. It should be initialized with [POOL_GROUP_INIT] and only touched by the
+ * [pool] functions afterwards.
+ */
+struct pool_group {
+    unsigned pending; //!< [pending] is the number of unfinished tasks in the group.
+};
+
+#define POOL_GROUP_INIT { 0 }
+
+typedef void (*pool_task_func_t)(void *arg);
+
+/**
+ * [pool_alloc jobs] creates a pool that runs at most [jobs] tasks at once.
+ * [jobs] must be at least 1.
+ */
+struct pool *pool_alloc(unsigned jobs);
+void pool_free(struct pool *pool);
+
+/**
+ * [pool_jobs pool] returns the number of tasks [pool] can run at once.
+ */
+unsigned pool_jobs(const struct pool *pool);
+
+/**
+ * [pool_submit pool group fn arg] queues the call [fn(arg)] on [pool] as part
+ * of [group]. Tasks are started in the order they are submitted.
+ */
+void pool_submit(struct pool *pool, struct pool_group *group, pool_task_func_t fn, void *arg);
+
+/**
+ * [pool_wait pool group] returns once every task in [group] has finished.
+ */
+void pool_wait(struct pool *pool, struct pool_group *group);
+
+/**
+ * [pool_for pool n fn ctx] calls [fn(ctx, i)] for every [i] in [0, n) across
+ * the pool and returns when all of the calls have finished. The order of the
+ * calls is unspecified.
+ */
+void pool_for(struct pool *pool, unsigned n, void (*fn)(void *ctx, unsigned i), void *ctx);
+
+/**
+ * [ncpus] returns the number of online processors, or 1 if it can't be
+ * determined.
+ */
+unsigned ncpus();
+
+#endif
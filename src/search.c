@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <math.h>
+#include <assert.h>
+#include <time.h>
+
+#include "pool.h"
+#include "pack.h"
+#include "search.h"
+
+/**
+ * [SEARCH_HALVINGS] is how many times the unit is halved to get the other
+ * units that are tried.
+ */
+#define SEARCH_HALVINGS 2
+
+/**
+ * A [candidate] is one combination of order, engine, rule and unit to try,
+ * along with its outcome.
+ */
+struct candidate {
+    enum order order;
+    struct packopts opts;
+    unsigned unit;
+
+    bool done; //!< [done] is set once the candidate has been packed.
+    unsigned w; //!< [w] is the width of the packed image in pixels.
+    unsigned h; //!< [h] is the height of the packed image in pixels.
+    struct posn *at; //!< [at] holds the positions found, in specification order.
+};
+
+/**
+ * A [searchctx] is shared by the tasks of one [search].
+ */
+struct searchctx {
+    const struct box *sizes;
+    unsigned n;
+    struct candidate *candidates;
+    struct timespec deadline;
+    bool limited; //!< [limited] is set if [deadline] applies.
+};
+
+/**
+ * A [sortkey] is what [order_cmp] sorts by. [qsort] doesn't take a context
+ * argument, so the keys are copied next to the indices being sorted.
+ */
+struct sortkey {
+    unsigned long long key;
+    unsigned i;
+};
+
+static unsigned long long
+order_key(enum order order, const struct box *b)
+{
+    switch (order) {
+    case ORDER_MAX_SIDE: return b->w > b->h ? b->w : b->h;
+    case ORDER_AREA: return (unsigned long long)b->w * b->h;
+    case ORDER_HEIGHT: return b->h;
+    case ORDER_WIDTH: return b->w;
+    case ORDER_PERIMETER: return (unsigned long long)b->w + b->h;
+    }
+    return 0;
+}
+
+/**
+ * [order_cmp a b] sorts [sortkey]s by decreasing key, then by increasing
+ * index so that the order is fully determined.
+ */
+static int
+order_cmp(const void *a, const void *b)
+{
+    const struct sortkey *i = a;
+    const struct sortkey *j = b;
+
+    if (i->key != j->key)
+        return i->key < j->key ? 1 : -1;
+    return i->i < j->i ? -1 : i->i > j->i;
+}
+
+const char *
+order_name(enum order order)
+{
+    switch (order) {
+    case ORDER_MAX_SIDE: return "max-side";
+    case ORDER_AREA: return "area";
+    case ORDER_HEIGHT: return "height";
+    case ORDER_WIDTH: return "width";
+    case ORDER_PERIMETER: return "perimeter";
+    }
+    return "?";
+}
+
+static bool
+past(const struct timespec *deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec > deadline->tv_sec
+        || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/**
+ * [search_one ctx i] packs the [i]th candidate of the [searchctx] [ctx]. It is
+ * intended for use with [pool_for].
+ */
+static void
+search_one(void *ctx, unsigned i)
+{
+    struct searchctx *sc = ctx;
+    struct candidate *c = &sc->candidates[i];
+
+    if (i > 0 && sc->limited && past(&sc->deadline))
+        return;
+
+    struct sortkey *keys = malloc(sc->n * sizeof(struct sortkey) + 1);
+    assert(keys != NULL);
+    struct box *boxes = malloc(sc->n * sizeof(struct box) + 1);
+    assert(boxes != NULL);
+    struct posn *at = malloc(sc->n * sizeof(struct posn) + 1);
+    assert(at != NULL);
+
+    for (unsigned k = 0; k < sc->n; k++) {
+        keys[k].key = order_key(c->order, &sc->sizes[k]);
+        keys[k].i = k;
+    }
+    qsort(keys, sc->n, sizeof(struct sortkey), order_cmp);
+
+    for (unsigned k = 0; k < sc->n; k++) {
+        const struct box *size = &sc->sizes[keys[k].i];
+        boxes[k].w = ceil((double)size->w / c->unit);
+        boxes[k].h = ceil((double)size->h / c->unit);
+    }
+
+    pack(&c->opts, boxes, sc->n, at, NULL);
+
+    c->at = malloc(sc->n * sizeof(struct posn) + 1);
+    assert(c->at != NULL);
+
+    c->w = 0;
+    c->h = 0;
+    for (unsigned k = 0; k < sc->n; k++) {
+        const struct box *size = &sc->sizes[keys[k].i];
+        c->at[keys[k].i] = at[k];
+
+        unsigned wp = at[k].x * c->unit + size->w;
+        unsigned hp = at[k].y * c->unit + size->h;
+        if (wp > c->w)
+            c->w = wp;
+        if (hp > c->h)
+            c->h = hp;
+    }
+    c->done = true;
+
+    free(keys);
+    free(boxes);
+    free(at);
+}
+
+static unsigned long long
+pot(unsigned v)
+{
+    unsigned long long p = 1;
+    while (p < v)
+        p *= 2;
+    return p;
+}
+
+/**
+ * [better metric a b] returns [true] iff the candidate [a] is strictly
+ * smaller than [b] according to [metric], falling back to plain area.
+ */
+static bool
+better(enum metric metric, const struct candidate *a, const struct candidate *b)
+{
+    unsigned long long aa = (unsigned long long)a->w * a->h;
+    unsigned long long ba = (unsigned long long)b->w * b->h;
+
+    if (metric == METRIC_POT) {
+        unsigned long long ap = pot(a->w) * pot(a->h);
+        unsigned long long bp = pot(b->w) * pot(b->h);
+        if (ap != bp)
+            return ap < bp;
+    }
+
+    return aa < ba;
+}
+
+void
+search(struct pool *pool, const struct searchopts *opts, const struct box *sizes, unsigned n,
+        const struct packopts *base, unsigned unit, struct posn *at, struct searchresult *result)
+{
+    static const struct {
+        enum engine engine;
+        enum rule rule;
+    } packers[] = {
+        { ENGINE_FRONTIER, RULE_BOTTOM_LEFT },
+        { ENGINE_SKYLINE, RULE_BOTTOM_LEFT },
+        { ENGINE_SKYLINE, RULE_MIN_WASTE },
+        { ENGINE_MAXRECTS, RULE_SHORT_SIDE },
+        { ENGINE_MAXRECTS, RULE_LONG_SIDE },
+        { ENGINE_MAXRECTS, RULE_AREA },
+        { ENGINE_MAXRECTS, RULE_BOTTOM_LEFT },
+        { ENGINE_MAXRECTS, RULE_CONTACT },
+    };
+    static const enum order orders[] = {
+        ORDER_MAX_SIDE, ORDER_AREA, ORDER_HEIGHT, ORDER_WIDTH, ORDER_PERIMETER,
+    };
+    const unsigned npackers = sizeof(packers) / sizeof(packers[0]);
+    const unsigned norders = sizeof(orders) / sizeof(orders[0]);
+
+    unsigned max = 1 + (SEARCH_HALVINGS + 1) * norders * npackers;
+    struct candidate *candidates = calloc(max, sizeof(struct candidate));
+    assert(candidates != NULL);
+
+    // The first candidate is what we'd have done without searching, so that
+    // a tight budget is never worse than no search at all.
+    unsigned len = 0;
+    candidates[len].order = ORDER_MAX_SIDE;
+    candidates[len].opts = *base;
+    candidates[len].unit = unit;
+    len++;
+
+    // The rest are tried from the coarsest unit down, since finer units are
+    // slower to pack. Only halvings that still divide [unit] are used.
+    unsigned units[SEARCH_HALVINGS + 1];
+    unsigned nunits = 0;
+    for (unsigned u = unit; nunits <= SEARCH_HALVINGS; u /= 2) {
+        units[nunits++] = u;
+        if (u % 2)
+            break;
+    }
+
+    for (unsigned k = 0; k < nunits; k++) {
+        unsigned u = units[k];
+
+        for (unsigned o = 0; o < norders; o++) {
+            for (unsigned p = 0; p < npackers; p++) {
+                struct candidate *c = &candidates[len];
+                c->order = orders[o];
+                c->opts = *base;
+                c->opts.engine = packers[p].engine;
+                c->opts.rule = packers[p].rule;
+                c->unit = u;
+
+                if (c->unit == candidates[0].unit && c->order == candidates[0].order
+                        && c->opts.engine == candidates[0].opts.engine
+                        && (c->opts.engine == ENGINE_FRONTIER || c->opts.rule == candidates[0].opts.rule))
+                    continue;
+                len++;
+            }
+        }
+    }
+
+    struct searchctx sc = { sizes, n, candidates };
+    sc.limited = opts->budget > 0;
+    if (sc.limited) {
+        clock_gettime(CLOCK_MONOTONIC, &sc.deadline);
+        sc.deadline.tv_sec += opts->budget / 1000;
+        sc.deadline.tv_nsec += (long)(opts->budget % 1000) * 1000000;
+        if (sc.deadline.tv_nsec >= 1000000000) {
+            sc.deadline.tv_sec++;
+            sc.deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pool_for(pool, len, search_one, &sc);
+
+    // Pick the winner in candidate order, so ties go to the earlier one no
+    // matter which finished first.
+    unsigned best = 0;
+    result->tried = 0;
+    for (unsigned i = 0; i < len; i++) {
+        if (!candidates[i].done)
+            continue;
+        result->tried++;
+        if (better(opts->metric, &candidates[i], &candidates[best]))
+            best = i;
+    }
+
+    struct candidate *c = &candidates[best];
+    for (unsigned k = 0; k < n; k++) {
+        at[k] = c->at[k];
+    }
+
+    result->order = c->order;
+    result->opts = c->opts;
+    result->unit = c->unit;
+    result->w = c->w;
+    result->h = c->h;
+    result->candidates = len;
+
+    for (unsigned i = 0; i < len; i++) {
+        free(candidates[i].at);
+    }
+    free(candidates);
+}
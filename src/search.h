@@ -0,0 +1,72 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+
+#include "pool.h"
+#include "pack.h"
+
+/**
+ * A [metric] measures how good a packing is; smaller is better.
+ */
+enum metric {
+    METRIC_AREA, //!< The area of the packed image.
+    METRIC_POT, //!< The area of the packed image once both sides are rounded up to powers of two.
+};
+
+/**
+ * An [order] is a key that images are sorted by, in decreasing order, before
+ * being packed.
+ */
+enum order {
+    ORDER_MAX_SIDE, //!< The greater of width and height. This is the order used without a search.
+    ORDER_AREA,
+    ORDER_HEIGHT,
+    ORDER_WIDTH,
+    ORDER_PERIMETER,
+};
+
+/**
+ * A [searchopts] structure configures [search].
+ */
+struct searchopts {
+    enum metric metric;
+    /**
+     * [budget] is the number of milliseconds after which no new candidates
+     * are started, or 0 for no limit. The first candidate always runs.
+     */
+    unsigned budget;
+};
+
+/**
+ * A [searchresult] describes the candidate packing [search] settled on.
+ */
+struct searchresult {
+    enum order order;
+    struct packopts opts;
+    unsigned unit;
+    unsigned w; //!< [w] is the width of the packed image in pixels.
+    unsigned h; //!< [h] is the height of the packed image in pixels.
+    unsigned tried; //!< [tried] is the number of candidates that ran.
+    unsigned candidates; //!< [candidates] is the number of candidates there were.
+};
+
+/**
+ * [search pool opts sizes n base unit at result] packs the [n] images whose
+ * sizes in pixels are [sizes] with every combination of [order], engine and
+ * rule, and [unit] and a few of its halvings, in parallel on [pool], and
+ * keeps the packing that is smallest according to [opts->metric].
+ * The first candidate is the packing that would have been used without a
+ * search: [ORDER_MAX_SIDE] with [base] at [unit]. Ties go to the candidate
+ * that comes first in a fixed order, so the outcome only depends on the
+ * inputs (and on which candidates ran, if [opts->budget] cuts the search
+ * short).
+ * The position of image [i], in units of [result->unit], is stored into
+ * [at[i]].
+ */
+void search(struct pool *pool, const struct searchopts *opts, const struct box *sizes, unsigned n,
+        const struct packopts *base, unsigned unit, struct posn *at, struct searchresult *result);
+
+const char *order_name(enum order order);
+
+#endif
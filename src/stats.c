@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <sys/resource.h>
+
+#include "stats.h"
+
+static const char *const names[STAGES] = {
+    [STAGE_PARSE] = "parse",
+    [STAGE_HASH] = "hash",
+    [STAGE_DECODE] = "decode",
+    [STAGE_TRIM] = "trim",
+    [STAGE_DEDUP] = "dedup",
+    [STAGE_SORT] = "sort",
+    [STAGE_PACK] = "pack",
+    [STAGE_COMPOSITE] = "composite",
+    [STAGE_ENCODE] = "encode",
+    [STAGE_EMIT] = "emit",
+    [STAGE_CACHE] = "cache",
+};
+
+/**
+ * [seconds a b] returns the time from [a] to [b] in seconds.
+ */
+static double
+seconds(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+void
+timer_start(struct timer *timer)
+{
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timer->cpu);
+}
+
+void
+timer_stop(const struct timer *timer, struct stagetime *into)
+{
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    into->wall += seconds(&timer->wall, &wall);
+    into->cpu += seconds(&timer->cpu, &cpu);
+}
+
+const char *
+stage_name(enum stage stage)
+{
+    return names[stage];
+}
+
+long
+peak_rss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+
+#ifdef __APPLE__
+    // macOS counts in bytes rather than kilobytes.
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+void
+json_string(FILE *out, const char *s)
+{
+    putc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            putc(c, out);
+    }
+    putc('"', out);
+}
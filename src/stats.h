@@ -0,0 +1,72 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * A [stage] is one of the steps of running a specification that --stats
+ * reports the time of. See the README.
+ */
+enum stage {
+    STAGE_PARSE,
+    STAGE_HASH,
+    STAGE_DECODE,
+    STAGE_TRIM,
+    STAGE_DEDUP,
+    STAGE_SORT,
+    STAGE_PACK,
+    STAGE_COMPOSITE,
+    STAGE_ENCODE,
+    STAGE_EMIT,
+    STAGE_CACHE,
+};
+
+/**
+ * [STAGES] is the number of [stage]s.
+ */
+#define STAGES (STAGE_CACHE + 1)
+
+/**
+ * A [stagetime] accumulates the wall-clock and CPU time spent in a stage, in
+ * seconds.
+ */
+struct stagetime {
+    double wall;
+    double cpu; //!< [cpu] is the time used by the whole process, across all of its threads.
+};
+
+/**
+ * A [timer] remembers when it was started with [timer_start], so that
+ * [timer_stop] can add the time since to a [stagetime]. Starting and stopping
+ * a timer takes a couple of system calls at most, so stages are always timed.
+ */
+struct timer {
+    struct timespec wall;
+    struct timespec cpu;
+};
+
+void timer_start(struct timer *timer);
+
+/**
+ * [timer_stop timer into] adds the time since [timer] was started to [into].
+ */
+void timer_stop(const struct timer *timer, struct stagetime *into);
+
+/**
+ * [stage_name stage] returns the name of [stage] used in --stats output.
+ */
+const char *stage_name(enum stage stage);
+
+/**
+ * [peak_rss] returns the largest resident set size the process has had, in
+ * kilobytes, or 0 if it can't be determined.
+ */
+long peak_rss();
+
+/**
+ * [json_string out s] writes [s] to [out] as a quoted JSON string.
+ */
+void json_string(FILE *out, const char *s);
+
+#endif
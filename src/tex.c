@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "lz4.h"
+#include "tex.h"
+
+static void
+put32le(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+bool
+tex_write(const char *path, const unsigned char *row, ptrdiff_t pitch, unsigned w, unsigned h, bool bgra,
+        unsigned compression)
+{
+    size_t rowlen = 4 * (size_t)w;
+    size_t len = rowlen * h;
+    if (len >= UINT32_MAX) {
+        fprintf(stderr, "tex_write: %ux%u is too large for a texture container\n", w, h);
+        return false;
+    }
+
+    // The pixels are gathered top-down and without padding, in RGBA order,
+    // which is what the generated loader hands to SDL_UpdateTexture.
+    unsigned char *pixels = malloc(len + 1);
+    assert(pixels != NULL);
+
+    for (unsigned y = 0; y < h; y++) {
+        const unsigned char *src = row + (ptrdiff_t)y * pitch;
+        unsigned char *dst = pixels + y * rowlen;
+
+        if (!bgra) {
+            memcpy(dst, src, rowlen);
+            continue;
+        }
+        for (size_t i = 0; i < rowlen; i += 4) {
+            dst[i] = src[i + 2];
+            dst[i + 1] = src[i + 1];
+            dst[i + 2] = src[i];
+            dst[i + 3] = src[i + 3];
+        }
+    }
+
+    const unsigned char *payload = pixels;
+    size_t payloadlen = len;
+    unsigned char *compressed = NULL;
+
+    if (compression == TEX_LZ4) {
+        compressed = malloc(lz4_bound(len));
+        assert(compressed != NULL);
+        payloadlen = lz4_compress(pixels, len, compressed);
+        payload = compressed;
+    }
+
+    unsigned char header[4 * TEX_HEADER_WORDS];
+    put32le(header, TEX_MAGIC);
+    put32le(header + 4, TEX_VERSION);
+    put32le(header + 8, w);
+    put32le(header + 12, h);
+    put32le(header + 16, TEX_RGBA8);
+    put32le(header + 20, compression);
+    put32le(header + 24, payloadlen);
+    put32le(header + 28, 0);
+
+    bool ok = false;
+
+    FILE *stream = fopen(path, "wb");
+    if (stream == NULL) {
+        fprintf(stderr, "tex_write: fopen: failed to open file at %s for writing: %s\n", path, strerror(errno));
+        goto close;
+    }
+
+    fwrite(header, 1, sizeof(header), stream);
+    fwrite(payload, 1, payloadlen, stream);
+
+    ok = !ferror(stream);
+    if (fclose(stream))
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "tex_write: failed to write %s: %s\n", path, strerror(errno));
+
+close:
+    free(compressed);
+    free(pixels);
+    return ok;
+}
@@ -0,0 +1,40 @@
+#ifndef TEX_H
+#define TEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A texture container holds the pixels of a packed image ready to be handed
+ * to the GPU. It starts with a header of [TEX_HEADER_WORDS] little-endian
+ * 32-bit words:
+ *
+ * 0. the magic number [TEX_MAGIC], i.e. the bytes "PSQT"
+ * 1. the version, [TEX_VERSION]
+ * 2. the width in pixels
+ * 3. the height in pixels
+ * 4. the pixel format, always [TEX_RGBA8]: R, G, B and A bytes
+ * 5. the compression, [TEX_RAW] or [TEX_LZ4]
+ * 6. the number of bytes of pixel data after the header
+ * 7. reserved, 0
+ *
+ * and then the rows of pixels, top to bottom, without padding, either as is
+ * or compressed into a single LZ4 block. See lz4.h.
+ */
+#define TEX_HEADER_WORDS 8
+#define TEX_MAGIC 0x54515350u
+#define TEX_VERSION 1
+#define TEX_RGBA8 1
+#define TEX_RAW 0
+#define TEX_LZ4 1
+
+/**
+ * [tex_write path row pitch w h bgra compression] writes the [w] by [h] image
+ * of 32-bit pixels to [path] as a texture container, compressed with
+ * [compression]. [row], [pitch] and [bgra] are as for [encode_png].
+ * Returns [false] (after printing an error) on failure.
+ */
+bool tex_write(const char *path, const unsigned char *row, ptrdiff_t pitch, unsigned w, unsigned h, bool bgra,
+        unsigned compression);
+
+#endif
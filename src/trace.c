@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "stats.h"
+#include "trace.h"
+
+/**
+ * An [event] is a span recorded by [trace_end].
+ */
+struct event {
+    struct timespec start;
+    struct timespec end;
+    unsigned tid; //!< [tid] is the id of the thread that recorded the span.
+    const char *cat; //!< [cat] is the category of the span, which outlives the trace.
+    char *name;
+    char *args; //!< [args] holds the members of the span's [args] object, or is null.
+};
+
+/**
+ * [tracing] is set between [trace_open] and [trace_close]. Only the thread
+ * that opened the trace changes it, while no other is recording spans.
+ */
+static bool tracing = false;
+
+static FILE *out; //!< [out] is where the trace is written.
+static struct timespec origin; //!< [origin] is when tracing started, which the trace's timestamps count from.
+
+/**
+ * [lock] guards [events] and [nthreads]. Threads get their ids from
+ * [nthreads], and keep them under [key].
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct event *events;
+static size_t nevents;
+static size_t cap;
+static unsigned nthreads;
+static pthread_key_t key;
+
+/**
+ * [micros a b] returns the time from [a] to [b] in microseconds.
+ */
+static double
+micros(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+bool
+trace_open(const char *path)
+{
+    out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "trace_open: failed to open %s for writing: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if (pthread_key_create(&key, NULL)) {
+        fprintf(stderr, "trace_open: pthread_key_create: failed to create a thread key\n");
+        fclose(out);
+        return false;
+    }
+
+    // The opening thread is the main one, which gets the first id.
+    nthreads = 1;
+    pthread_setspecific(key, (void *)(uintptr_t)nthreads);
+
+    events = NULL;
+    nevents = 0;
+    cap = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+    tracing = true;
+    return true;
+}
+
+bool
+trace_close()
+{
+    if (!tracing)
+        return true;
+    tracing = false;
+
+    fprintf(out, "{\"traceEvents\": [\n");
+    for (unsigned t = 1; t <= nthreads; t++) {
+        fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ", t);
+        if (t == 1)
+            fprintf(out, "\"main\"");
+        else
+            fprintf(out, "\"worker %u\"", t - 1);
+        fprintf(out, "}},\n");
+    }
+
+    for (size_t i = 0; i < nevents; i++) {
+        const struct event *e = &events[i];
+        fprintf(out, "{\"name\": ");
+        json_string(out, e->name);
+        fprintf(out, ", \"cat\": ");
+        json_string(out, e->cat);
+        fprintf(out, ", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u",
+                micros(&origin, &e->start), micros(&e->start, &e->end), e->tid);
+        if (e->args != NULL)
+            fprintf(out, ", \"args\": {%s}", e->args);
+        fprintf(out, "}%s\n", i + 1 < nevents ? "," : "");
+
+        free(e->name);
+        free(e->args);
+    }
+    fprintf(out, "], \"displayTimeUnit\": \"ms\"}\n");
+
+    free(events);
+    pthread_key_delete(key);
+
+    bool ok = !ferror(out);
+    if (fclose(out))
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "trace_close: failed to write the trace: %s\n", strerror(errno));
+    return ok;
+}
+
+void
+trace_begin(struct timespec *start)
+{
+    if (tracing)
+        clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void
+trace_end(const struct timespec *start, const char *cat, const char *name, const char *detail,
+        const char *args, ...)
+{
+    if (!tracing)
+        return;
+
+    struct event e;
+    clock_gettime(CLOCK_MONOTONIC, &e.end);
+    e.start = *start;
+    e.cat = cat;
+
+    // Everything is formatted before taking the lock, to hold it briefly.
+    size_t len = strlen(name);
+    if (detail != NULL)
+        len += 1 + strlen(detail);
+    e.name = malloc(len + 1);
+    assert(e.name != NULL);
+    if (detail != NULL)
+        sprintf(e.name, "%s %s", name, detail);
+    else
+        strcpy(e.name, name);
+
+    e.args = NULL;
+    if (args != NULL) {
+        va_list ap, aq;
+        va_start(ap, args);
+        va_copy(aq, ap);
+        int n = vsnprintf(NULL, 0, args, ap);
+        assert(n >= 0);
+        e.args = malloc(n + 1);
+        assert(e.args != NULL);
+        vsnprintf(e.args, n + 1, args, aq);
+        va_end(aq);
+        va_end(ap);
+    }
+
+    pthread_mutex_lock(&lock);
+
+    uintptr_t tid = (uintptr_t)pthread_getspecific(key);
+    if (tid == 0) {
+        tid = ++nthreads;
+        pthread_setspecific(key, (void *)tid);
+    }
+    e.tid = tid;
+
+    if (nevents == cap) {
+        cap = cap == 0 ? 1024 : 2 * cap;
+        events = realloc(events, cap * sizeof(struct event));
+        assert(events != NULL);
+    }
+    events[nevents++] = e;
+
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/**
+ * Tracing records spans of time spent by each thread, and writes them in the
+ * Chrome trace-event format that chrome://tracing and Perfetto read. It is
+ * off until [trace_open] is called, and until then [trace_begin] and
+ * [trace_end] return straight away, so they can be left in hot code.
+ * Tracing must be opened before any other thread records a span, and closed
+ * after they're all done.
+ */
+
+/**
+ * [trace_open path] starts tracing, to be written to [path] by
+ * [trace_close]. The file is created straight away. Returns [false] (after
+ * printing an error) on failure.
+ */
+bool trace_open(const char *path);
+
+/**
+ * [trace_close] writes every span recorded since [trace_open] and stops
+ * tracing. It does nothing if tracing is off. Returns [false] (after printing
+ * an error) on failure.
+ */
+bool trace_close();
+
+/**
+ * [trace_begin start] sets [start] to the current time, if tracing is on.
+ */
+void trace_begin(struct timespec *start);
+
+/**
+ * [trace_end start cat name detail args ...] records a span of the calling
+ * thread from [start] (as set by [trace_begin], or by [timer_start]) until
+ * now, if tracing is on. The span is in the category [cat] and named [name],
+ * followed by [detail] unless it's null. If [args] isn't null, it is a printf
+ * format for the members of the span's JSON [args] object, formatted with the
+ * remaining arguments.
+ */
+void trace_end(const struct timespec *start, const char *cat, const char *name, const char *detail,
+        const char *args, ...);
+
+#endif
@@ -0,0 +1,104 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#include "trim.h"
+
+// The scans below test four pixels (16 bytes) at a time with two 64-bit
+// loads, which is where nearly all of the time goes for mostly transparent
+// images. Individual pixels are only looked at once a group of four has
+// something visible in it. memcpy keeps the loads legal at any alignment and
+// compiles down to plain loads.
+
+static inline uint32_t
+pixel(const unsigned char *row, unsigned x)
+{
+    uint32_t v;
+    memcpy(&v, row + 4 * (size_t)x, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+pixels4(const unsigned char *row, unsigned x)
+{
+    uint64_t a, b;
+    memcpy(&a, row + 4 * (size_t)x, sizeof(a));
+    memcpy(&b, row + 4 * (size_t)x + 8, sizeof(b));
+    return a | b;
+}
+
+/**
+ * [first_visible row from to alpha] returns the first x in [from, to) at which
+ * [row] has a visible pixel, or [to] if there is none.
+ */
+static unsigned
+first_visible(const unsigned char *row, unsigned from, unsigned to, uint32_t alpha)
+{
+    uint64_t alpha2 = (uint64_t)alpha << 32 | alpha;
+
+    unsigned x = from;
+    while (x + 4 <= to && !(pixels4(row, x) & alpha2))
+        x += 4;
+    for (; x < to; x++) {
+        if (pixel(row, x) & alpha)
+            return x;
+    }
+    return to;
+}
+
+/**
+ * [last_visible row from to alpha] returns one past the last x in [from, to)
+ * at which [row] has a visible pixel, or [from] if there is none.
+ */
+static unsigned
+last_visible(const unsigned char *row, unsigned from, unsigned to, uint32_t alpha)
+{
+    uint64_t alpha2 = (uint64_t)alpha << 32 | alpha;
+
+    unsigned x = to;
+    while (x >= from + 4 && !(pixels4(row, x - 4) & alpha2))
+        x -= 4;
+    for (; x > from; x--) {
+        if (pixel(row, x - 1) & alpha)
+            return x;
+    }
+    return from;
+}
+
+bool
+trim_bounds(const unsigned char *row, ptrdiff_t pitch, unsigned w, unsigned h, uint32_t alpha,
+        struct trim *trim)
+{
+    // [top] and [bottom] are the first visible row and one past the last.
+    unsigned top = 0;
+    while (top < h && first_visible(row + (ptrdiff_t)top * pitch, 0, w, alpha) == w)
+        top++;
+    if (top == h)
+        return false;
+
+    unsigned bottom = h;
+    while (first_visible(row + (ptrdiff_t)(bottom - 1) * pitch, 0, w, alpha) == w)
+        bottom--;
+
+    // [left] and [right] only ever widen, so each row only needs to be
+    // scanned outside of the columns already known to be inside the bounds.
+    // The first row sets both.
+    unsigned left = w;
+    unsigned right = 0;
+    for (unsigned y = top; y < bottom; y++) {
+        const unsigned char *r = row + (ptrdiff_t)y * pitch;
+
+        left = first_visible(r, 0, left, alpha);
+        unsigned end = last_visible(r, right, w, alpha);
+        if (end > right)
+            right = end;
+    }
+
+    trim->x = left;
+    trim->y = top;
+    trim->w = right - left;
+    trim->h = bottom - top;
+    return true;
+}
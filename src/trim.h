@@ -0,0 +1,31 @@
+#ifndef TRIM_H
+#define TRIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A [trim] is a rectangle of pixels within an image, with (0, 0) at the
+ * top-left corner.
+ */
+struct trim {
+    unsigned x;
+    unsigned y;
+    unsigned w;
+    unsigned h;
+};
+
+/**
+ * [trim_bounds row pitch w h alpha trim] finds the smallest rectangle holding
+ * every visible pixel of a [w] by [h] image of 32-bit pixels, and stores it
+ * into [trim]. [row] points to the top row of the image, and each row starts
+ * [pitch] bytes after the one above it, so bottom-up images can be passed
+ * with a negative [pitch]. A pixel is visible iff it has a bit of the mask
+ * [alpha] set, reading the pixel as a native [uint32_t].
+ * Returns [false] if no pixel is visible, in which case [trim] is untouched.
+ */
+bool trim_bounds(const unsigned char *row, ptrdiff_t pitch, unsigned w, unsigned h, uint32_t alpha,
+        struct trim *trim);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "watch.h"
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/**
+ * [WATCH_EVENTS] are the inotify events that mean a file in a directory
+ * changed. Editors often save by writing a new file and renaming it over the
+ * old one, which only shows up as a move.
+ */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/**
+ * [WATCH_BUFFER] is the size of the buffer events are read into.
+ */
+#define WATCH_BUFFER 4096
+
+struct watcher {
+    int fd; //!< [fd] is the inotify instance.
+};
+
+struct watcher *
+watcher_alloc()
+{
+    struct watcher *w = malloc(sizeof(struct watcher));
+    assert(w != NULL);
+
+    w->fd = inotify_init();
+    if (w->fd < 0) {
+        fprintf(stderr, "watcher_alloc: inotify_init: %s\n", strerror(errno));
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+void
+watcher_free(struct watcher *w)
+{
+    close(w->fd);
+    free(w);
+}
+
+int
+watcher_add(struct watcher *w, const char *dir)
+{
+    int id = inotify_add_watch(w->fd, dir, WATCH_EVENTS | IN_ONLYDIR);
+    if (id < 0)
+        fprintf(stderr, "watcher_add: failed to watch %s: %s\n", dir, strerror(errno));
+    return id;
+}
+
+void
+watcher_remove(struct watcher *w, int id)
+{
+    inotify_rm_watch(w->fd, id);
+}
+
+bool
+watcher_wait(struct watcher *w, watcher_fn_t fn, void *ctx, unsigned settle)
+{
+    // Events are read into a union with [inotify_event] so they're aligned.
+    union {
+        struct inotify_event event;
+        char bytes[WATCH_BUFFER];
+    } buf;
+
+    bool changed = false;
+    for (;;) {
+        struct pollfd pfd = { w->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, changed ? (int)settle : -1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0) {
+            fprintf(stderr, "watcher_wait: poll: %s\n", strerror(errno));
+            return false;
+        }
+        if (ready == 0)
+            return true;
+
+        ssize_t len = read(w->fd, buf.bytes, sizeof(buf.bytes));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0) {
+            fprintf(stderr, "watcher_wait: read: %s\n", len < 0 ? strerror(errno) : "end of file");
+            return false;
+        }
+
+        for (ssize_t at = 0; at < len;) {
+            const struct inotify_event *event = (const struct inotify_event *)(buf.bytes + at);
+            if (event->mask & IN_Q_OVERFLOW) {
+                if (fn(ctx, -1, NULL))
+                    changed = true;
+            } else if (event->len > 0 && fn(ctx, event->wd, event->name)) {
+                changed = true;
+            }
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+#else
+
+struct watcher *
+watcher_alloc()
+{
+    fprintf(stderr, "watcher_alloc: watching files is only supported on Linux\n");
+    return NULL;
+}
+
+void
+watcher_free(struct watcher *w)
+{
+}
+
+int
+watcher_add(struct watcher *w, const char *dir)
+{
+    return -1;
+}
+
+void
+watcher_remove(struct watcher *w, int id)
+{
+}
+
+bool
+watcher_wait(struct watcher *w, watcher_fn_t fn, void *ctx, unsigned settle)
+{
+    return false;
+}
+
+#endif
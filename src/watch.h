@@ -0,0 +1,51 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+/**
+ * A [watcher] reports changes to the files in a set of directories, using
+ * inotify. It only exists on Linux; elsewhere [watcher_alloc] fails.
+ * Watchers are created using [watcher_alloc] and freed with [watcher_free].
+ */
+struct watcher;
+
+/**
+ * [watcher_alloc] creates a watcher of no directories. Returns null (after
+ * printing an error) on failure.
+ */
+struct watcher *watcher_alloc();
+void watcher_free(struct watcher *w);
+
+/**
+ * [watcher_add w dir] starts watching the directory [dir], and returns a
+ * non-negative id for it, or -1 (after printing an error) on failure.
+ * Adding the same directory twice returns the same id.
+ */
+int watcher_add(struct watcher *w, const char *dir);
+
+/**
+ * [watcher_remove w id] stops watching the directory with the given [id].
+ */
+void watcher_remove(struct watcher *w, int id);
+
+/**
+ * [watcher_fn_t] is called by [watcher_wait] with the id of the directory of
+ * each file that changed and the file's name, and returns [true] if the
+ * change matters. If the kernel dropped events because they came too fast,
+ * it is called with an id of -1 and a null name, and any file may have
+ * changed.
+ */
+typedef bool (*watcher_fn_t)(void *ctx, int id, const char *name);
+
+/**
+ * [watcher_wait w fn ctx settle] waits until a file in one of the watched
+ * directories is written, created, moved or removed, calling [fn(ctx, id,
+ * name)] for every change. Once a change matters, it waits until no more
+ * arrive for [settle] milliseconds, since saving a file often takes an editor
+ * several steps, and returns [true]. Returns [false] (after printing an
+ * error) on failure.
+ */
+bool watcher_wait(struct watcher *w, watcher_fn_t fn, void *ctx, unsigned settle);
+
+#endif